@@ -4,6 +4,8 @@
 
 # Uncomment to build the unit tests
 # CONFIG += unittest
+# Uncomment to build the command line tool gaussianbeam-cli instead of the graphical interface
+# CONFIG += cli
 
 include(po/po.pri)
 
@@ -13,7 +15,8 @@ TEMPLATE = app
 TARGET = gaussianbeam
 DEPENDPATH += .
 QT += xml xmlpatterns
-QMAKE_CXXFLAGS += -pedantic -Wno-long-long -Wno-unused-local-typedefs -g
+QMAKE_CXXFLAGS += -std=c++11 -pedantic -Wno-long-long -Wno-unused-local-typedefs -g
+unix:LIBS += -lpthread
 CONFIG += release warn_on stl qt
 macx:CONFIG += x86 ppc                # Generate Universal Binary for Mac OS X
 win32:RC_FILE = gui/GaussianBeam.rc   # Embed the application icon
@@ -37,17 +40,30 @@ unittest {
         SOURCES += test/test.cpp
         TARGET = gaussianbeamtest
 }
-!unittest{
+# Command line tool
+cli {
+        QT -= gui widgets
+        CONFIG += console
+        CONFIG -= app_bundle
+        SOURCES += cli/main.cpp
+        TARGET = gaussianbeam-cli
+}
+!unittest:!cli{
         SOURCES += gui/main.cpp
 }
 
 # Input
 # src
-HEADERS += src/GaussianBeam.h src/Optics.h src/OpticsBench.h src/Statistics.h src/GaussianFit.h \
-           src/Function.h src/OpticsFunction.h src/Cavity.h src/Utils.h src/lmmin.h src/Delegate.h
-SOURCES += src/GaussianBeam.cpp src/Optics.cpp src/OpticsBench.cpp src/GaussianFit.cpp \
-           src/Function.cpp src/OpticsFunction.cpp src/Cavity.cpp src/Utils.cpp src/lmmin.c
+HEADERS += src/GaussianBeam.h src/BeamProfile.h src/Optics.h src/OpticsBench.h src/Statistics.h src/GaussianFit.h \
+           src/Function.h src/OpticsFunction.h src/ParameterFunction.h src/ToleranceAnalysis.h src/CatalogSearch.h src/FitBootstrap.h src/BeamImage.h src/Cavity.h src/Utils.h src/lmmin.h src/Delegate.h \
+           src/Parallel.h src/Trace.h
+SOURCES += src/GaussianBeam.cpp src/BeamProfile.cpp src/Optics.cpp src/OpticsBench.cpp src/GaussianFit.cpp \
+           src/Function.cpp src/OpticsFunction.cpp src/ParameterFunction.cpp src/ToleranceAnalysis.cpp src/CatalogSearch.cpp src/FitBootstrap.cpp src/BeamImage.cpp src/Cavity.cpp src/Utils.cpp src/lmmin.c
+# io
+HEADERS += io/BenchFile.h
+SOURCES += io/BenchFile.cpp
 # gui
+!cli {
 HEADERS += gui/GaussianBeamWidget.h gui/OpticsView.h gui/OpticsWidgets.h gui/GaussianBeamDelegate.h \
            gui/GaussianBeamModel.h gui/GaussianBeamWindow.h gui/Unit.h gui/Names.h
 SOURCES += gui/GaussianBeamWidget.cpp gui/OpticsView.cpp gui/OpticsWidgets.cpp gui/GaussianBeamDelegate.cpp \
@@ -55,3 +71,5 @@ SOURCES += gui/GaussianBeamWidget.cpp gui/OpticsView.cpp gui/OpticsWidgets.cpp g
            gui/GaussianBeamSave.cpp gui/GaussianBeamLoad.cpp
 FORMS   += gui/GaussianBeamWidget.ui gui/GaussianBeamWindow.ui gui/OpticsViewProperties.ui
 RESOURCES = gui/GaussianBeam.qrc
+}
+cli:RESOURCES = cli/cli.qrc
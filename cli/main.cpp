@@ -0,0 +1,459 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2007-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/**
+* gaussianbeam-cli: batch processing of GaussianBeam files without the graphical interface.
+* Each file given on the command line is loaded, processed by the requested command,
+* and the results are written to the standard output in JSON or CSV format.
+*/
+
+#include "io/BenchFile.h"
+#include "src/OpticsBench.h"
+#include "src/GaussianFit.h"
+#include "src/Cavity.h"
+#include "src/Trace.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QList>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+/// A field of a result record. Numbers and booleans are already formatted, numbers that are not finite being empty
+struct Field
+{
+	QString key;
+	QString value;
+	/// The value is a string, quoted by the output format
+	bool string;
+};
+
+/// A result record: ordered list of fields
+typedef QList<Field> Record;
+
+enum OutputFormat {JsonFormat, CsvFormat};
+
+struct Options
+{
+	QString command;
+	OutputFormat format;
+	unsigned int seed;
+	bool hasSeed;
+	double closingFreeSpace;
+	QStringList files;
+};
+
+/////////////////////////////////////////////////
+// Formatting
+
+/// Quote a JSON string
+QString quote(const QString& string)
+{
+	QString result = string;
+	result.replace("\\", "\\\\");
+	result.replace("\"", "\\\"");
+	result.replace("\n", "\\n");
+	return "\"" + result + "\"";
+}
+
+/// Quote a CSV field: quotes are doubled (RFC 4180)
+QString csvQuote(const QString& string)
+{
+	QString result = string;
+	result.replace("\"", "\"\"");
+	return "\"" + result + "\"";
+}
+
+QString jsonValue(const Field& field)
+{
+	if (field.string)
+		return quote(field.value);
+
+	return field.value.isEmpty() ? QString("null") : field.value;
+}
+
+QString csvValue(const Field& field)
+{
+	return field.string ? csvQuote(field.value) : field.value;
+}
+
+QString number(double value)
+{
+	// QString::number writes nan and inf, that are not valid JSON
+	if (!(fabs(value) < numeric_limits<double>::infinity()))
+		return QString();
+
+	return QString::number(value, 'g', 12);
+}
+
+void add(Record& record, const QString& key, double value)
+{
+	const Field field = {key, number(value), false};
+	record << field;
+}
+
+void add(Record& record, const QString& key, const QString& value)
+{
+	const Field field = {key, value, true};
+	record << field;
+}
+
+void addBool(Record& record, const QString& key, bool value)
+{
+	const Field field = {key, QString(value ? "true" : "false"), false};
+	record << field;
+}
+
+void addBeam(Record& record, const QString& prefix, const Beam& beam)
+{
+	add(record, prefix + "waistH", beam.waist(Horizontal));
+	add(record, prefix + "waistV", beam.waist(Vertical));
+	add(record, prefix + "waistPositionH", beam.waistPosition(Horizontal));
+	add(record, prefix + "waistPositionV", beam.waistPosition(Vertical));
+	add(record, prefix + "rayleighH", beam.rayleigh(Horizontal));
+	add(record, prefix + "rayleighV", beam.rayleigh(Vertical));
+	add(record, prefix + "wavelength", beam.wavelength());
+	add(record, prefix + "index", beam.index());
+	add(record, prefix + "M2", beam.M2());
+}
+
+/**
+* Write the results of the files. In JSON format, the output is an array of one object per file,
+* written as the files are processed. In CSV format, each record is a row starting with the file name,
+* whether the file was processed successfully, and its error. A file without records, e.g. a file that
+* cannot be read, has a row of its own. The rows are written at the end, under a header taken from the first record.
+*/
+class Output
+{
+public:
+	Output(OutputFormat format) : m_format(format), m_first(true)
+	{
+		if (m_format == JsonFormat)
+			cout << "[";
+	}
+
+	~Output()
+	{
+		if (m_format == JsonFormat)
+			cout << "\n]" << endl;
+		else
+			writeCsv();
+	}
+
+	void write(const QString& fileName, const QString& error, bool success, const QList<Record>& records)
+	{
+		if (m_format == JsonFormat)
+			writeJson(fileName, error, success, records);
+		else
+		{
+			const FileResult result = {fileName, error, success, records};
+			m_results << result;
+		}
+		m_first = false;
+	}
+
+private:
+	struct FileResult
+	{
+		QString fileName;
+		QString error;
+		bool success;
+		QList<Record> records;
+	};
+
+	void writeJson(const QString& fileName, const QString& error, bool success, const QList<Record>& records)
+	{
+		cout << (m_first ? "\n" : ",\n");
+		cout << "  {\"file\": " << quote(fileName).toUtf8().constData();
+		if (!error.isEmpty())
+			cout << ", \"error\": " << quote(error).toUtf8().constData();
+		cout << ", \"success\": " << (success ? "true" : "false");
+		cout << ", \"results\": [";
+		for (int i = 0; i < records.size(); i++)
+		{
+			cout << (i == 0 ? "\n" : ",\n") << "    {";
+			for (Record::const_iterator field = records[i].begin(); field != records[i].end(); field++)
+				cout << (field == records[i].begin() ? "" : ", ") << quote(field->key).toUtf8().constData()
+				     << ": " << jsonValue(*field).toUtf8().constData();
+			cout << "}";
+		}
+		cout << (records.isEmpty() ? "]}" : "\n  ]}");
+	}
+
+	void writeCsv() const
+	{
+		Record header;
+		for (QList<FileResult>::const_iterator result = m_results.begin(); result != m_results.end(); result++)
+			if (!result->records.isEmpty())
+			{
+				header = result->records.first();
+				break;
+			}
+
+		cout << "file,success,error";
+		for (Record::const_iterator field = header.begin(); field != header.end(); field++)
+			cout << "," << field->key.toUtf8().constData();
+		cout << endl;
+
+		for (QList<FileResult>::const_iterator result = m_results.begin(); result != m_results.end(); result++)
+		{
+			const QString file = csvQuote(result->fileName) + (result->success ? ",true," : ",false,") +
+			                     (result->error.isEmpty() ? QString() : csvQuote(result->error));
+			if (result->records.isEmpty())
+				cout << file.toUtf8().constData() << endl;
+			for (QList<Record>::const_iterator record = result->records.begin(); record != result->records.end(); record++)
+			{
+				cout << file.toUtf8().constData();
+				for (Record::const_iterator field = record->begin(); field != record->end(); field++)
+					cout << "," << csvValue(*field).toUtf8().constData();
+				cout << endl;
+			}
+		}
+	}
+
+private:
+	OutputFormat m_format;
+	bool m_first;
+	QList<FileResult> m_results;
+};
+
+/////////////////////////////////////////////////
+// Commands
+
+void beams(const OpticsBench& bench, QList<Record>& records)
+{
+	for (int i = 0; i < bench.nOptics(); i++)
+	{
+		const Optics* optics = bench.optics(i);
+		const Beam* beam = bench.beam(i);
+		Record record;
+		add(record, "optics", double(i));
+		add(record, "name", QString::fromUtf8(optics->name().c_str()));
+		add(record, "type", BenchFile::opticsName(optics->type()));
+		add(record, "position", optics->position());
+		add(record, "radiusH", beam->radius(optics->position(), Horizontal));
+		add(record, "radiusV", beam->radius(optics->position(), Vertical));
+		addBeam(record, "", *beam);
+		records << record;
+	}
+}
+
+bool fits(OpticsBench& bench, QList<Record>& records)
+{
+	bool success = true;
+
+	for (int i = 0; i < bench.nFit(); i++)
+	{
+		Fit* fit = bench.fit(i);
+		Record record;
+		add(record, "fit", double(i));
+		add(record, "name", QString::fromUtf8(fit->name().c_str()));
+		add(record, "orientation", BenchFile::orientationName(fit->orientation()));
+		add(record, "size", double(fit->size()));
+		// Same test as the fit jobs of OpticsBench: fitAvailable does not take the Ellipsoidal orientation
+		const bool available = fit->fitAvailable(Horizontal) || fit->fitAvailable(Vertical);
+		addBool(record, "available", available);
+		Beam beam(bench.wavelength());
+		double residue = 0.;
+		if (available)
+			residue = fit->applyFit(beam);
+		else
+			success = false;
+		add(record, "residue", residue);
+		addBeam(record, "", beam);
+		records << record;
+	}
+
+	return success;
+}
+
+bool cavity(OpticsBench& bench, double closingFreeSpace, QList<Record>& records)
+{
+	Cavity& cavity = bench.cavity();
+	for (int i = 0; i < bench.nOptics(); i++)
+		if (bench.optics(i)->isABCD())
+			cavity.addOptics(dynamic_cast<const ABCD*>(bench.optics(i)));
+	cavity.setClosingFreeSpace(closingFreeSpace);
+
+	const bool stable = cavity.isStable();
+	Record record;
+	addBool(record, "stable", stable);
+	if (stable)
+		addBeam(record, "", *cavity.eigenBeam(bench.wavelength(), 0));
+	records << record;
+
+	return stable;
+}
+
+bool optimize(OpticsBench& bench, bool magicWaist, QList<Record>& records)
+{
+	const bool found = magicWaist ? bench.magicWaist() : bench.localOptimum();
+
+	for (int i = 0; i < bench.nOptics(); i++)
+	{
+		Record record;
+		add(record, "optics", double(i));
+		add(record, "name", QString::fromUtf8(bench.optics(i)->name().c_str()));
+		add(record, "position", bench.optics(i)->position());
+		addBool(record, "found", found);
+		add(record, "overlap", bench.nOptics() > 0 ? Beam::overlap(*bench.beam(bench.nOptics() - 1), *bench.targetBeam()) : 0.);
+		records << record;
+	}
+
+	return found;
+}
+
+/////////////////////////////////////////////////
+// Main
+
+void usage()
+{
+	cerr << "Usage: gaussianbeam-cli [options] command file..." << endl
+	     << "Commands:" << endl
+	     << "  beams          beam after each optics" << endl
+	     << "  fits           waist fit of each data set" << endl
+	     << "  cavity         eigen-mode of the cavity made of all ABCD optics" << endl
+	     << "  magicwaist     search optics positions that produce the target beam" << endl
+	     << "  localoptimum   maximize the overlap with the target beam around the current positions" << endl
+	     << "Options:" << endl
+	     << "  --format json|csv    output format (default: json)" << endl
+	     << "  --seed N             seed of the magic waist search" << endl
+	     << "  --closing-space D    free space that closes the cavity (default: 0)" << endl
+	     << "  --trace none|info|debug" << endl;
+}
+
+bool parseArguments(const QStringList& arguments, Options& options)
+{
+	options.format = JsonFormat;
+	options.seed = 0;
+	options.hasSeed = false;
+	options.closingFreeSpace = 0.;
+
+	for (int i = 1; i < arguments.size(); i++)
+	{
+		const QString& argument = arguments[i];
+		const bool hasValue = i + 1 < arguments.size();
+		bool ok = true;
+
+		if ((argument == "--format") && hasValue)
+		{
+			const QString format = arguments[++i];
+			if (format == "json")
+				options.format = JsonFormat;
+			else if (format == "csv")
+				options.format = CsvFormat;
+			else
+				ok = false;
+		}
+		else if ((argument == "--seed") && hasValue)
+		{
+			options.seed = arguments[++i].toUInt(&ok);
+			options.hasSeed = true;
+		}
+		else if ((argument == "--closing-space") && hasValue)
+			options.closingFreeSpace = arguments[++i].toDouble(&ok);
+		else if ((argument == "--trace") && hasValue)
+		{
+			const QString level = arguments[++i];
+			if (level == "none")
+				Trace::setLevel(Trace::None);
+			else if (level == "info")
+				Trace::setLevel(Trace::Info);
+			else if (level == "debug")
+				Trace::setLevel(Trace::Debug);
+			else
+				ok = false;
+		}
+		else if (argument.startsWith("--"))
+			ok = false;
+		else if (options.command.isEmpty())
+			options.command = argument;
+		else
+			options.files << argument;
+
+		if (!ok)
+		{
+			cerr << "Invalid argument: " << argument.toUtf8().constData() << endl;
+			return false;
+		}
+	}
+
+	const QStringList commands = QStringList() << "beams" << "fits" << "cavity" << "magicwaist" << "localoptimum";
+	if (!commands.contains(options.command) || options.files.isEmpty())
+		return false;
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	Q_INIT_RESOURCE(cli);
+
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setOrganizationName("GaussianBeam");
+	QCoreApplication::setApplicationName("GaussianBeam");
+	QCoreApplication::setApplicationVersion("0.5");
+
+	Options options;
+	if (!parseArguments(app.arguments(), options))
+	{
+		usage();
+		return 2;
+	}
+
+	int status = 0;
+	Output output(options.format);
+
+	for (QStringList::const_iterator it = options.files.constBegin(); it != options.files.constEnd(); it++)
+	{
+		OpticsBench bench;
+		if (options.hasSeed)
+			bench.setOptimizationSeed(options.seed);
+
+		QString error;
+		QList<Record> records;
+		bool success = BenchFile(bench).read(*it, error);
+
+		if (success)
+		{
+			if (options.command == "beams")
+				beams(bench, records);
+			else if (options.command == "fits")
+				success = fits(bench, records);
+			else if (options.command == "cavity")
+				success = cavity(bench, options.closingFreeSpace, records);
+			else if (options.command == "magicwaist")
+				success = optimize(bench, true, records);
+			else if (options.command == "localoptimum")
+				success = optimize(bench, false, records);
+		}
+		else
+			cerr << it->toUtf8().constData() << ": " << error.toUtf8().constData() << endl;
+
+		if (!success)
+			status = 1;
+
+		output.write(*it, error, success, records);
+	}
+
+	return status;
+}
@@ -33,6 +33,7 @@
 #include <QColorDialog>
 #include <QInputDialog>
 #include <QSettings>
+#include <QTimer>
 
 #include <cmath>
 
@@ -73,9 +74,15 @@ GaussianBeamWidget::GaussianBeamWidget(OpticsBench* bench, GaussianBeamWindow* w
 	fitTable->setColumnWidth(0, 82);
 	fitTable->setColumnWidth(1, 82);
 
+	// Background optimization
+	m_jobTimer = new QTimer(this);
+	m_jobTimer->setInterval(100);
+	m_jobButton = 0;
+
 	// Connect slots
 	connect(fitModel, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)),
 	        this, SLOT(fitModelChanged(const QModelIndex&, const QModelIndex&)));
+	connect(m_jobTimer, SIGNAL(timeout()), this, SLOT(processJobs()));
 
 	// Set up default values
 	on_checkBox_ShowTargetBeam_toggled(checkBox_ShowTargetBeam->isChecked());
@@ -277,20 +284,63 @@ void GaussianBeamWidget::on_checkBox_ShowTargetBeam_toggled(bool checked)
 
 void GaussianBeamWidget::on_pushButton_MagicWaist_clicked()
 {
+	startJob(MagicWaistJob, pushButton_MagicWaist);
+}
+
+void GaussianBeamWidget::on_pushButton_LocalOptimum_clicked()
+{
+	startJob(LocalOptimumJob, pushButton_LocalOptimum);
+}
+
+void GaussianBeamWidget::startJob(OpticsBenchJobType type, QPushButton* button)
+{
+	// The button of the running job cancels it
+	if (m_bench->jobRunning())
+	{
+		m_bench->cancelJob();
+		return;
+	}
+
 	label_MagicWaistResult->setText("");
+	if (!m_bench->startJob(type))
+		return;
 
-	if (!m_bench->magicWaist())
-		label_MagicWaistResult->setText(tr("Desired waist could not be found !"));
-	else
-		displayOverlap();
+	m_jobButton = button;
+	m_jobButtonText = button->text();
+	button->setText(tr("Cancel"));
+	pushButton_MagicWaist->setEnabled(button == pushButton_MagicWaist);
+	pushButton_LocalOptimum->setEnabled(button == pushButton_LocalOptimum);
+	m_jobTimer->start();
 }
 
-void GaussianBeamWidget::on_pushButton_LocalOptimum_clicked()
+void GaussianBeamWidget::processJobs()
 {
-	if (!m_bench->localOptimum())
-		label_MagicWaistResult->setText(tr("Local optimum not found !"));
-	else
+	m_bench->processJobs();
+}
+
+void GaussianBeamWidget::onOpticsBenchJobProgress(OpticsBenchJobType type, double progress, double bestOverlap)
+{
+	if ((type != MagicWaistJob) && (type != LocalOptimumJob))
+		return;
+
+	label_MagicWaistResult->setText(tr("Searching: %1 %, best overlap %2 %").arg(int(progress*100.)).arg(bestOverlap*100., 0, 'f', 2));
+}
+
+void GaussianBeamWidget::onOpticsBenchJobFinished(OpticsBenchJobType type, bool success)
+{
+	m_jobTimer->stop();
+	if (m_jobButton)
+		m_jobButton->setText(m_jobButtonText);
+	m_jobButton = 0;
+	pushButton_MagicWaist->setEnabled(true);
+	pushButton_LocalOptimum->setEnabled(true);
+
+	if (success)
 		displayOverlap();
+	else if (type == MagicWaistJob)
+		label_MagicWaistResult->setText(tr("Desired waist could not be found !"));
+	else if (type == LocalOptimumJob)
+		label_MagicWaistResult->setText(tr("Local optimum not found !"));
 }
 
 void GaussianBeamWidget::onOpticsBenchTargetBeamChanged()
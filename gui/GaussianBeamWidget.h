@@ -28,6 +28,7 @@
 class QStandardItemModel;
 class QDomElement;
 class QAction;
+class QTimer;
 class GaussianBeamWindow;
 
 class GaussianBeamWidget : public QWidget,
@@ -53,6 +54,8 @@ protected:
 	virtual void onOpticsBenchFitsRemoved(int index, int count);
 	virtual void onOpticsBenchFitDataChanged(int index);
 	virtual void onOpticsBenchWavelengthChanged();
+	virtual void onOpticsBenchJobProgress(OpticsBenchJobType type, double progress, double bestOverlap);
+	virtual void onOpticsBenchJobFinished(OpticsBenchJobType type, bool success);
 
 // UI slots
 protected slots:
@@ -84,9 +87,11 @@ protected slots:
 
 private slots:
 	void fitModelChanged(const QModelIndex& start = QModelIndex(), const QModelIndex& stop = QModelIndex());
+	void processJobs();
 
 private:
 	void displayOverlap();
+	void startJob(OpticsBenchJobType type, QPushButton* button);
 	void updateUnits();
 	void insertOptics(OpticsType opticsType);
 	void updateTargetInformation();
@@ -103,6 +108,11 @@ private:
 	QItemSelectionModel* fitSelectionModel;
 
 	bool m_updatingFit, m_updatingTarget;
+
+	// Background optimization
+	QTimer* m_jobTimer;
+	QPushButton* m_jobButton;
+	QString m_jobButtonText;
 };
 
 #endif
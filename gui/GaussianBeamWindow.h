@@ -88,27 +88,14 @@ private:
 	void readSettings();
 	void writeSettings();
 
-// Loading stuff that should logically be moved to OpticsBench, but depend on Qt.
-// In addition, a GaussianBeam file contains view properties that do not belong to OpticsBench.
+// Loading and saving. The bench is handled by BenchFile, and
+// a GaussianBeam file additionally contains the view properties.
 private:
-	void convertFormat(QByteArray* data, const QString& xsltPath) const;
 	bool parseFile(const QString& path = QString());
 	void parseXml(const QDomElement& element);
-	void parseBench(const QDomElement& element);
-	void parseTargetBeam(const QDomElement& element);
-	void parseBeam(const QDomElement& element, Beam& beam);
-	void parseFit(const QDomElement& element);
-	void parseOptics(const QDomElement& element, QMap<int, Optics*>& opticsList, QMap<int, int>& lockTree);
 	void parseView(const QDomElement& element);
 	bool writeFile(const QString& path = QString());
-	void writeOrientedElement(QXmlStreamWriter& xmlWriter, QString name, QString data, Orientation orientation) const;
-	void writeBench(QXmlStreamWriter& xmlWriter) const;
-	void writeWaist(QXmlStreamWriter& xmlWriter, const Beam* beam, Orientation orientation) const;
-	void writeBeam(QXmlStreamWriter& xmlWriter, const Beam* beam) const;
-	void writeOptics(QXmlStreamWriter& xmlWriter, const Optics* optics) const;
 	void writeView(QXmlStreamWriter& xmlWriter) const;
-	// Compatibility functions
-	void parseInputBeam11(const QDomElement& element, QList<QString>& lockTree);
 
 private:
 	QToolBar* m_fileToolBar;
@@ -21,6 +21,7 @@
 #include "gui/GaussianBeamModel.h"
 #include "gui/Unit.h"
 #include "src/GaussianBeam.h"
+#include "src/BeamProfile.h"
 #include "src/Utils.h"
 #include "src/OpticsBench.h"
 #include "src/GaussianFit.h"
@@ -795,10 +796,17 @@ void BeamItem::drawUpperBeamSegment(double start, double stop, double pixel, int
 	// "pixel" is added to avoid overlong iterations due to very small steps caused by rounding errors
 	double step = qMax((stop - start)/double(nStep) + pixel, pixel);
 
-	// minus sign for the upper beam because the Qt coordinates system points downwoards
+	QVector<double> positions;
 	for (double z = start; z < stop; z += step)
-		polygon.append(QPointF(z, -m_beam->radius(z, m_orientationCache)));
-	polygon.append(QPointF(stop, -m_beam->radius(stop, m_orientationCache)));
+		positions.append(z);
+	positions.append(stop);
+
+	QVector<double> radii(positions.size());
+	BeamProfile(*m_beam, m_orientationCache).evaluate(Property::BeamRadius, 0, positions.constData(), positions.size(), radii.data());
+
+	// minus sign for the upper beam because the Qt coordinates system points downwoards
+	for (int i = 0; i < positions.size(); i++)
+		polygon.append(QPointF(positions[i], -radii[i]));
 }
 
 void BeamItem::drawLowerBeamSegment(double start, double stop, double pixel, int nStep, QPolygonF& polygon) const
@@ -812,9 +820,16 @@ void BeamItem::drawLowerBeamSegment(double start, double stop, double pixel, int
 	// "pixel" is added to avoid overlong iterations due to very small steps caused by rounding errors
 	double step = qMax((stop - start)/double(nStep) + pixel, pixel);
 
+	QVector<double> positions;
 	for (double z = stop; z > start; z -= step)
-		polygon.append(QPointF(z, m_beam->radius(z, m_orientationCache)));
-	polygon.append(QPointF(start, m_beam->radius(start, m_orientationCache)));
+		positions.append(z);
+	positions.append(start);
+
+	QVector<double> radii(positions.size());
+	BeamProfile(*m_beam, m_orientationCache).evaluate(Property::BeamRadius, 0, positions.constData(), positions.size(), radii.data());
+
+	for (int i = 0; i < positions.size(); i++)
+		polygon.append(QPointF(positions[i], radii[i]));
 }
 
 void BeamItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
@@ -0,0 +1,602 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2007-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "io/BenchFile.h"
+#include "src/GaussianFit.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QBuffer>
+#include <QtXmlPatterns/QXmlQuery>
+
+/**************************************************************
+Change log for GaussianBeam files. All this changes are coded in XSL-T documents
+able to automatically perform file format conversion
+
+File versions:
+==============
+
+GaussianBeam 0.1 -> file version 1.0
+GaussianBeam 0.2 -> file version 1.0
+GaussianBeam 0.3 -> file version 1.0
+GaussianBeam 0.4 -> file version 1.1
+GaussianBeam 0.5 -> file version 1.2
+
+GaussianBeam 0.2 (1.0)
+======================
+
+	New <flatMirror> and <genericABCD> tags
+
+GaussianBeam 0.3 (1.0)
+======================
+
+	<scramble> deprecated
+	New <showTargetWaist>, <absoluteLock> and <relativeLockParent> tags
+
+GaussianBeam 0.4 (1.1)
+======================
+
+	New <bench id="0"> and <view id="0" bench="0"> tags
+
+	<magicWaist> -> <targetBeam id="0">
+		<targetWaist> -> <waist>
+		<targetPosition> -> <position>
+		New <minOverlap> and <overlapCriterion> tags
+		<showTargetWaist> -> <showTargetBeam> (in <view>)
+
+	<waistFit> -> <beamFit id="n">
+		New <name> and <color> tags
+		<fitDataType> -> <dataType>
+		<fitData> -> <data id = "n">
+			<dataPosition> -> <position>
+			<dataValue> -> <value>
+
+	<display> dropped. Values transfered to <view>
+
+	New <opticsList> tag
+
+	New <dielectricSlab> and <curvedMirror> tags
+
+GaussianBeam 0.5 (1.2)
+======================
+
+
+
+***************************************************************/
+
+BenchFile::BenchFile(OpticsBench& bench)
+	: m_bench(bench)
+{
+}
+
+/////////////////////////////////////////////////
+// Names
+
+QString BenchFile::orientationName(Orientation orientation)
+{
+	if (orientation == Horizontal)
+		return "horizontal";
+	else if (orientation == Vertical)
+		return "vertical";
+	else if (orientation == Ellipsoidal)
+		return "ellipsoidal";
+
+	return "spherical";
+}
+
+Orientation BenchFile::orientation(const QString& name)
+{
+	if (name == "horizontal")
+		return Horizontal;
+	else if (name == "vertical")
+		return Vertical;
+	else if (name == "ellipsoidal")
+		return Ellipsoidal;
+
+	return Spherical;
+}
+
+QString BenchFile::opticsName(OpticsType type)
+{
+	switch (type)
+	{
+		case CreateBeamType:      return "createBeam";
+		case LensType:            return "lens";
+		case ThickLensType:       return "thickLens";
+		case FlatMirrorType:      return "flatMirror";
+		case CurvedMirrorType:    return "curvedMirror";
+		case FlatInterfaceType:   return "flatInterface";
+		case CurvedInterfaceType: return "curvedInterface";
+		case DielectricSlabType:  return "dielectricSlab";
+		case ThermalLensType:     return "thermalLens";
+		case GenericABCDType:     return "genericABCD";
+		default:                  return QString();
+	}
+}
+
+/////////////////////////////////////////////////
+// Reading
+
+void BenchFile::convertFormat(QByteArray* data, const QString& xsltPath)
+{
+	QXmlQuery query(QXmlQuery::XSLT20);
+	QByteArray convertedData;
+	QBuffer inputBuffer(data);
+	QBuffer outputBuffer(&convertedData);
+
+	inputBuffer.open(QIODevice::ReadOnly);
+	outputBuffer.open(QIODevice::WriteOnly);
+	// Set the data to convert
+	query.setFocus(&inputBuffer);
+	// Set the xslt style-sheet
+	QFile xslt(xsltPath);
+	xslt.open(QFile::ReadOnly);
+	query.setQuery(&xslt);
+	xslt.close();
+	// Convert
+	query.evaluateTo(&outputBuffer);
+	outputBuffer.close();
+	inputBuffer.close();
+	*data = convertedData;
+}
+
+bool BenchFile::readDocument(const QString& fileName, QDomDocument& document, QString& error)
+{
+	// Load data
+	QFile file(fileName);
+	if (!(file.open(QFile::ReadOnly | QFile::Text)))
+	{
+		error = QCoreApplication::translate("BenchFile", "Cannot read file %1:\n%2.").arg(fileName).arg(file.errorString());
+		return false;
+	}
+	QByteArray data = file.readAll();
+	file.close();
+
+	// Convert old file versions
+	convertFormat(&data, ":/xslt/1_0_to_1_1.xsl");
+	convertFormat(&data, ":/xslt/1_1_to_1_2.xsl");
+
+	// Parse XML file
+	QString errorStr;
+	int errorLine;
+	int errorColumn;
+
+	if (!document.setContent(data, true, &errorStr, &errorLine, &errorColumn))
+	{
+		error = QCoreApplication::translate("BenchFile", "Parse error at line %1, column %2:\n%3").arg(errorLine).arg(errorColumn).arg(errorStr);
+		return false;
+	}
+
+	// XML version
+	QDomElement root = document.documentElement();
+	if (root.tagName() != "gaussianBeam")
+	{
+		error = QCoreApplication::translate("BenchFile", "The file is not an GaussianBeam file.");
+		return false;
+	}
+
+	if (!root.hasAttribute("version"))
+	{
+		error = QCoreApplication::translate("BenchFile", "This file does not contain any version information.");
+		return false;
+	}
+
+	if (root.attribute("version") != "1.2")
+	{
+		error = QCoreApplication::translate("BenchFile", "Your version of GaussianBeam is too old.");
+		return false;
+	}
+
+	return true;
+}
+
+bool BenchFile::read(const QString& fileName, QString& error)
+{
+	QDomDocument document;
+	if (!readDocument(fileName, document, error))
+		return false;
+
+	m_bench.clear();
+
+	for (QDomElement child = document.documentElement().firstChildElement("bench");
+	     !child.isNull(); child = child.nextSiblingElement("bench"))
+		parseBench(child);
+
+	return true;
+}
+
+void BenchFile::parseBench(const QDomElement& element)
+{
+	QDomElement child = element.firstChildElement();
+
+	while (!child.isNull())
+	{
+		if (child.tagName() == "wavelength")
+			m_bench.setWavelength(child.text().toDouble());
+		else if (child.tagName() == "leftBoundary")
+			m_bench.setLeftBoundary(child.text().toDouble());
+		else if (child.tagName() == "rightBoundary")
+			m_bench.setRightBoundary(child.text().toDouble());
+		else if (child.tagName() == "targetBeam")
+			parseTargetBeam(child);
+		else if (child.tagName() == "beamFit")
+			parseFit(child);
+		else if (child.tagName() == "opticsList")
+		{
+			QMap<int, Optics*> opticsList; // Key = id
+			QMap<int, int> lockTree;       // Key = child id, value = parent id
+
+			QDomElement opticsElement = child.firstChildElement();
+			while (!opticsElement.isNull())
+			{
+				parseOptics(opticsElement, opticsList, lockTree);
+				opticsElement = opticsElement.nextSiblingElement();
+			}
+
+			for(QMap<int, int>::const_iterator it = lockTree.constBegin(); it != lockTree.constEnd(); ++it)
+			{
+				Optics* opticsChild  = opticsList.value(it.key());
+				Optics* opticsParent = opticsList.value(it.value());
+				if (opticsChild && opticsParent)
+					opticsChild->relativeLockTo(opticsParent);
+			}
+		}
+		else
+			qDebug() << " -> Unknown tag: " << child.tagName();
+
+		child = child.nextSiblingElement();
+	}
+}
+
+void BenchFile::parseTargetBeam(const QDomElement& element)
+{
+	Beam targetBeam = *m_bench.targetBeam();
+	parseBeam(element, targetBeam);
+	m_bench.setTargetBeam(targetBeam);
+}
+
+void BenchFile::parseBeam(const QDomElement& element, Beam& beam)
+{
+	QDomElement child = element.firstChildElement();
+
+	while (!child.isNull())
+	{
+		/// @todo showTargetBeam is missing
+		if (child.tagName() == "waist")
+			beam.setWaist(child.text().toDouble(), orientation(child.attribute("orientation")));
+		else if (child.tagName() == "waistPosition")
+			beam.setWaistPosition(child.text().toDouble(), orientation(child.attribute("orientation")));
+		else if (child.tagName() == "wavelength")
+			beam.setWavelength(child.text().toDouble());
+		else if (child.tagName() == "index")
+			beam.setIndex(child.text().toDouble());
+		else if (child.tagName() == "M2")
+			beam.setM2(child.text().toDouble());
+		// The next tags are specific to target beams
+		else if ((child.tagName() == "targetOverlap") || (child.tagName() == "minOverlap"))
+			m_bench.setTargetOverlap(child.text().toDouble());
+		else if (child.tagName() == "targetOrientation")
+			m_bench.setTargetOrientation(Orientation(child.text().toInt()));
+		else
+			qDebug() << " -> Unknown tag in parseBeam: " << child.tagName();
+		child = child.nextSiblingElement();
+	}
+}
+
+void BenchFile::parseFit(const QDomElement& element)
+{
+	QDomElement child = element.firstChildElement();
+	Fit* fit = m_bench.addFit(m_bench.nFit());
+
+	while (!child.isNull())
+	{
+		if (child.tagName() == "name")
+			fit->setName(child.text().toUtf8().data());
+		else if (child.tagName() == "dataType")
+			fit->setDataType(FitDataType(child.text().toInt()));
+		else if (child.tagName() == "color")
+			fit->setColor(child.text().toUInt());
+		else if (child.tagName() == "orientation")
+			fit->setOrientation(orientation(child.text()));
+		else if (child.tagName() == "data")
+		{
+			QDomElement dataElement = child.firstChildElement();
+			double position = 0.;
+			bool added = false;
+			while (!dataElement.isNull())
+			{
+				if (dataElement.tagName() == "position")
+					position = dataElement.text().toDouble();
+				else if (dataElement.tagName() == "value")
+				{
+					double value = dataElement.text().toDouble();
+					Orientation valueOrientation = orientation(dataElement.attribute("orientation"));
+					if (added)
+						fit->setData(fit->size() - 1, position, value, valueOrientation);
+					else
+					{
+						fit->addData(position, value, valueOrientation);
+						added = true;
+					}
+				}
+				else
+					qDebug() << " -> Unknown tag: " << dataElement.tagName();
+				dataElement = dataElement.nextSiblingElement();
+			}
+		}
+		else
+			qDebug() << " -> Unknown tag: " << child.tagName();
+		child = child.nextSiblingElement();
+	}
+}
+
+void BenchFile::parseOptics(const QDomElement& element, QMap<int, Optics*>& opticsList, QMap<int, int>& lockTree)
+{
+	Optics* optics = 0;
+
+	if (element.tagName() == opticsName(CreateBeamType))
+		optics = new CreateBeam(1., 1., 1., "");
+	else if (element.tagName() == opticsName(LensType))
+		optics = new Lens(1., 1., "");
+	else if (element.tagName() == opticsName(FlatMirrorType))
+		optics = new FlatMirror(1., "");
+	else if (element.tagName() == opticsName(CurvedMirrorType))
+		optics = new CurvedMirror(1., 1., "");
+	else if (element.tagName() == opticsName(FlatInterfaceType))
+		optics = new FlatInterface(1., 1., "");
+	else if (element.tagName() == opticsName(CurvedInterfaceType))
+		optics = new CurvedInterface(1., 1., 1., "");
+	else if (element.tagName() == opticsName(DielectricSlabType))
+		optics = new DielectricSlab(1., 1., 1., "");
+	else if (element.tagName() == opticsName(GenericABCDType))
+		optics = new GenericABCD(1., 1., 1., 1., 1., 1., "");
+	else
+		qDebug() << " -> Unknown tag in parseOptics: " << element.tagName();
+
+	if (!optics)
+		return;
+
+	int id = element.attribute("id").toInt();
+
+	QDomElement child = element.firstChildElement();
+
+	while (!child.isNull())
+	{
+		if (child.tagName() == "position")
+			optics->setPosition(child.text().toDouble(), false);
+		else if (child.tagName() == "angle")
+			optics->setAngle(child.text().toDouble());
+		else if (child.tagName() == "orientation")
+			optics->setOrientation(orientation(child.text()));
+		else if (child.tagName() == "name")
+			optics->setName(child.text().toUtf8().data());
+		else if (child.tagName() == "absoluteLock")
+			optics->setAbsoluteLock(child.text().toInt() == 1 ? true : false);
+		else if (child.tagName() == "relativeLockParent")
+			lockTree[id] = child.text().toInt();
+		else if (child.tagName() == "width")
+			optics->setWidth(child.text().toDouble());
+		else if (child.tagName() == "focal")
+			dynamic_cast<Lens*>(optics)->setFocal(child.text().toDouble());
+		else if (child.tagName() == "curvatureRadius")
+			dynamic_cast<CurvedMirror*>(optics)->setCurvatureRadius(child.text().toDouble());
+		else if (child.tagName() == "indexRatio")
+			dynamic_cast<Dielectric*>(optics)->setIndexRatio(child.text().toDouble());
+		else if (child.tagName() == "surfaceRadius")
+			dynamic_cast<CurvedInterface*>(optics)->setSurfaceRadius(child.text().toDouble());
+		else if (child.tagName() == "A")
+			dynamic_cast<GenericABCD*>(optics)->setA(child.text().toDouble(), orientation(child.attribute("orientation")));
+		else if (child.tagName() == "B")
+			dynamic_cast<GenericABCD*>(optics)->setB(child.text().toDouble(), orientation(child.attribute("orientation")));
+		else if (child.tagName() == "C")
+			dynamic_cast<GenericABCD*>(optics)->setC(child.text().toDouble(), orientation(child.attribute("orientation")));
+		else if (child.tagName() == "D")
+			dynamic_cast<GenericABCD*>(optics)->setD(child.text().toDouble(), orientation(child.attribute("orientation")));
+		else if (child.tagName() == "beam")
+		{
+			Beam inputBeam;
+			parseBeam(child, inputBeam);
+			dynamic_cast<CreateBeam*>(optics)->setBeam(inputBeam);
+		}
+		else
+			qDebug() << " -> Unknown tag in parseOptics: " << child.tagName();
+
+		child = child.nextSiblingElement();
+	}
+
+	opticsList[id] = optics;
+	m_bench.addOptics(optics, m_bench.nOptics());
+}
+
+/////////////////////////////////////////////////
+// Writing
+
+void BenchFile::writeStartDocument(QXmlStreamWriter& xmlWriter)
+{
+	xmlWriter.setAutoFormatting(true);
+	xmlWriter.writeStartDocument("1.0");
+	xmlWriter.writeDTD("<!DOCTYPE gaussianBeam>");
+	xmlWriter.writeStartElement("gaussianBeam");
+	xmlWriter.writeAttribute("version", "1.2");
+}
+
+void BenchFile::writeEndDocument(QXmlStreamWriter& xmlWriter)
+{
+	xmlWriter.writeEndElement();
+	xmlWriter.writeEndDocument();
+}
+
+bool BenchFile::write(const QString& fileName, QString& error) const
+{
+	QFile file(fileName);
+	if (!file.open(QFile::WriteOnly | QFile::Text))
+	{
+		error = QCoreApplication::translate("BenchFile", "Cannot write file %1:\n%2.").arg(fileName).arg(file.errorString());
+		return false;
+	}
+
+	QXmlStreamWriter xmlWriter(&file);
+	writeStartDocument(xmlWriter);
+		xmlWriter.writeStartElement("bench");
+		xmlWriter.writeAttribute("id", "0");
+			writeBench(xmlWriter);
+		xmlWriter.writeEndElement();
+	writeEndDocument(xmlWriter);
+
+	file.close();
+	return true;
+}
+
+void BenchFile::writeOrientedElement(QXmlStreamWriter& xmlWriter, QString name, QString data, Orientation orientation) const
+{
+	xmlWriter.writeStartElement(name);
+	xmlWriter.writeAttribute("orientation", orientationName(orientation));
+	xmlWriter.writeCharacters(data);
+	xmlWriter.writeEndElement();
+}
+
+void BenchFile::writeWaist(QXmlStreamWriter& xmlWriter, const Beam* beam, Orientation orientation) const
+{
+	writeOrientedElement(xmlWriter, "waist", QString::number(beam->waist(orientation)), orientation);
+	writeOrientedElement(xmlWriter, "waistPosition", QString::number(beam->waistPosition(orientation)), orientation);
+}
+
+void BenchFile::writeBeam(QXmlStreamWriter& xmlWriter, const Beam* beam) const
+{
+	if (beam->isSpherical())
+		writeWaist(xmlWriter, beam, Spherical);
+	else
+	{
+		writeWaist(xmlWriter, beam, Horizontal);
+		writeWaist(xmlWriter, beam, Vertical);
+	}
+	xmlWriter.writeTextElement("wavelength", QString::number(beam->wavelength()));
+	xmlWriter.writeTextElement("index", QString::number(beam->index()));
+	xmlWriter.writeTextElement("M2", QString::number(beam->M2()));
+}
+
+void BenchFile::writeBench(QXmlStreamWriter& xmlWriter) const
+{
+	xmlWriter.writeTextElement("wavelength", QString::number(m_bench.wavelength()));
+	xmlWriter.writeTextElement("leftBoundary", QString::number(m_bench.leftBoundary()));
+	xmlWriter.writeTextElement("rightBoundary", QString::number(m_bench.rightBoundary()));
+
+	xmlWriter.writeStartElement("targetBeam");
+	xmlWriter.writeAttribute("id", "0");
+		writeBeam(xmlWriter, m_bench.targetBeam());
+		xmlWriter.writeTextElement("targetOverlap", QString::number(m_bench.targetOverlap()));
+		xmlWriter.writeTextElement("targetOrientation", QString::number(m_bench.targetOrientation()));
+		/// @todo should we save the "showTargetBeam" property ?
+	xmlWriter.writeEndElement();
+
+	for (int i = 0; i < m_bench.nFit(); i++)
+	{
+		Fit* fit = m_bench.fit(i);
+		xmlWriter.writeStartElement("beamFit");
+		xmlWriter.writeAttribute("id", QString::number(i));
+			xmlWriter.writeTextElement("name", QString::fromUtf8(fit->name().c_str()));
+			xmlWriter.writeTextElement("dataType", QString::number(int(fit->dataType())));
+			xmlWriter.writeTextElement("color", QString::number(fit->color()));
+			xmlWriter.writeTextElement("orientation", orientationName(fit->orientation()));
+			for (int j = 0; j < fit->size(); j++)
+			{
+				xmlWriter.writeStartElement("data");
+				xmlWriter.writeAttribute("id", QString::number(j));
+					xmlWriter.writeTextElement("position", QString::number(fit->position(j)));
+					if (fit->orientation() == Spherical)
+						writeOrientedElement(xmlWriter, "value", QString::number(fit->value(j, Spherical)), Spherical);
+					else
+					{
+						if (fit->orientation() != Vertical)
+							writeOrientedElement(xmlWriter, "value", QString::number(fit->value(j, Horizontal)), Horizontal);
+						if (fit->orientation() != Horizontal)
+							writeOrientedElement(xmlWriter, "value", QString::number(fit->value(j, Vertical  )), Vertical  );
+					}
+				xmlWriter.writeEndElement();
+			}
+		xmlWriter.writeEndElement();
+	}
+
+	xmlWriter.writeStartElement("opticsList");
+	for (int i = 0; i < m_bench.nOptics(); i++)
+	{
+		xmlWriter.writeStartElement(opticsName(m_bench.optics(i)->type()));
+		xmlWriter.writeAttribute("id", QString::number(i));
+		writeOptics(xmlWriter, m_bench.optics(i));
+		xmlWriter.writeEndElement();
+	}
+	xmlWriter.writeEndElement();
+}
+
+void BenchFile::writeOptics(QXmlStreamWriter& xmlWriter, const Optics* optics) const
+{
+	xmlWriter.writeTextElement("position", QString::number(optics->position()));
+	xmlWriter.writeTextElement("angle", QString::number(optics->angle()));
+	xmlWriter.writeTextElement("orientation", orientationName(optics->orientation()));
+	xmlWriter.writeTextElement("name", QString::fromUtf8(optics->name().c_str()));
+	xmlWriter.writeTextElement("absoluteLock", QString::number(optics->absoluteLock() ? true : false));
+	if (optics->relativeLockParent())
+		xmlWriter.writeTextElement("relativeLockParent", QString::number(m_bench.opticsIndex(optics->relativeLockParent())));
+
+	if (optics->type() == CreateBeamType)
+	{
+		xmlWriter.writeStartElement("beam");
+		writeBeam(xmlWriter, dynamic_cast<const CreateBeam*>(optics)->beam());
+		xmlWriter.writeEndElement();
+	}
+	else if (optics->type() == LensType)
+		xmlWriter.writeTextElement("focal", QString::number(dynamic_cast<const Lens*>(optics)->focal()));
+	else if (optics->type() == CurvedMirrorType)
+		xmlWriter.writeTextElement("curvatureRadius", QString::number(dynamic_cast<const CurvedMirror*>(optics)->curvatureRadius()));
+	else if (optics->type() == FlatInterfaceType)
+		xmlWriter.writeTextElement("indexRatio", QString::number(dynamic_cast<const FlatInterface*>(optics)->indexRatio()));
+	else if (optics->type() == CurvedInterfaceType)
+	{
+		xmlWriter.writeTextElement("indexRatio", QString::number(dynamic_cast<const CurvedInterface*>(optics)->indexRatio()));
+		xmlWriter.writeTextElement("surfaceRadius", QString::number(dynamic_cast<const CurvedInterface*>(optics)->surfaceRadius()));
+	}
+	else if (optics->type() == DielectricSlabType)
+	{
+		xmlWriter.writeTextElement("indexRatio", QString::number(dynamic_cast<const DielectricSlab*>(optics)->indexRatio()));
+		xmlWriter.writeTextElement("width", QString::number(optics->width()));
+	}
+	else if (optics->type() == GenericABCDType)
+	{
+		const GenericABCD* ABCDOptics = dynamic_cast<const GenericABCD*>(optics);
+		xmlWriter.writeTextElement("width", QString::number(optics->width()));
+		if (optics->orientation() == Spherical)
+		{
+			writeOrientedElement(xmlWriter, "A", QString::number(ABCDOptics->A(Spherical)), Spherical);
+			writeOrientedElement(xmlWriter, "B", QString::number(ABCDOptics->B(Spherical)), Spherical);
+			writeOrientedElement(xmlWriter, "C", QString::number(ABCDOptics->C(Spherical)), Spherical);
+			writeOrientedElement(xmlWriter, "D", QString::number(ABCDOptics->D(Spherical)), Spherical);
+		}
+		else
+		{
+			writeOrientedElement(xmlWriter, "A", QString::number(ABCDOptics->A(Horizontal)), Horizontal);
+			writeOrientedElement(xmlWriter, "A", QString::number(ABCDOptics->A(Vertical  )), Vertical  );
+			writeOrientedElement(xmlWriter, "B", QString::number(ABCDOptics->B(Horizontal)), Horizontal);
+			writeOrientedElement(xmlWriter, "B", QString::number(ABCDOptics->B(Vertical  )), Vertical  );
+			writeOrientedElement(xmlWriter, "C", QString::number(ABCDOptics->C(Horizontal)), Horizontal);
+			writeOrientedElement(xmlWriter, "C", QString::number(ABCDOptics->C(Vertical  )), Vertical  );
+			writeOrientedElement(xmlWriter, "D", QString::number(ABCDOptics->D(Horizontal)), Horizontal);
+			writeOrientedElement(xmlWriter, "D", QString::number(ABCDOptics->D(Vertical  )), Vertical  );
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2007-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BENCHFILE_H
+#define BENCHFILE_H
+
+#include "src/OpticsBench.h"
+
+#include <QString>
+#include <QMap>
+#include <QtXml/QDomDocument>
+#include <QtXml/QDomElement>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+	#include <QXmlStreamWriter>
+#else
+	#include <QtXml/QXmlStreamWriter>
+#endif
+
+/**
+* Reading and writing of the bench part of GaussianBeam files.
+* This only depends on the QtCore, QtXml and QtXmlPatterns modules, so that
+* files can be processed without the graphical interface.
+* The format conversion style-sheets are read from the :/xslt/ resource directory.
+* A GaussianBeam file may also contain view properties, that are left to the caller.
+*/
+class BenchFile
+{
+public:
+	BenchFile(OpticsBench& bench);
+
+public:
+	/**
+	* Read @p fileName into @p document, converting old file versions to the current version.
+	* @return false and set @p error if the file cannot be read or is not a valid GaussianBeam file
+	*/
+	static bool readDocument(const QString& fileName, QDomDocument& document, QString& error);
+	/// Clear the bench and fill it from the <bench> elements of file @p fileName
+	bool read(const QString& fileName, QString& error);
+	/// Write a file containing only the bench
+	bool write(const QString& fileName, QString& error) const;
+
+	/// Fill the bench from a <bench> element
+	void parseBench(const QDomElement& element);
+	/// Write the content of a <bench> element
+	void writeBench(QXmlStreamWriter& xmlWriter) const;
+
+	/// Start a GaussianBeam document. Close it with writeEndDocument
+	static void writeStartDocument(QXmlStreamWriter& xmlWriter);
+	static void writeEndDocument(QXmlStreamWriter& xmlWriter);
+
+private:
+	static void convertFormat(QByteArray* data, const QString& xsltPath);
+	void parseTargetBeam(const QDomElement& element);
+	void parseBeam(const QDomElement& element, Beam& beam);
+	void parseFit(const QDomElement& element);
+	void parseOptics(const QDomElement& element, QMap<int, Optics*>& opticsList, QMap<int, int>& lockTree);
+	void writeOrientedElement(QXmlStreamWriter& xmlWriter, QString name, QString data, Orientation orientation) const;
+	void writeWaist(QXmlStreamWriter& xmlWriter, const Beam* beam, Orientation orientation) const;
+	void writeBeam(QXmlStreamWriter& xmlWriter, const Beam* beam) const;
+	void writeOptics(QXmlStreamWriter& xmlWriter, const Optics* optics) const;
+
+public:
+	/// Names of orientations and optics types in GaussianBeam files
+	static QString orientationName(Orientation orientation);
+	static Orientation orientation(const QString& name);
+	static QString opticsName(OpticsType type);
+
+private:
+	OpticsBench& m_bench;
+};
+
+#endif
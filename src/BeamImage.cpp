@@ -0,0 +1,362 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "BeamImage.h"
+#include "GaussianFit.h"
+#include "Parallel.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+
+/// Maximum number of iterations of the integration area
+const int maxIterations = 20;
+
+/**
+* Read the next token of the header of a PGM file in @p token.
+* Metadata found in the comments are stored in @p image
+*/
+bool readToken(istream& file, string& token, BeamImage& image)
+{
+	token.clear();
+	for (int c = file.get(); c != EOF; c = file.get())
+	{
+		if (c == '#')
+		{
+			string comment, key;
+			getline(file, comment);
+			istringstream stream(comment);
+			double value;
+			if (stream >> key >> value)
+			{
+				if (key == "position")
+					image.position = value;
+				else if (key == "pixel_size")
+					image.pixelSize = value;
+			}
+			if (!token.empty())
+				return true;
+		}
+		else if (isspace(c))
+		{
+			// The whitespace that ends the token is consumed
+			if (!token.empty())
+				return true;
+		}
+		else
+			token += char(c);
+	}
+
+	return !token.empty();
+}
+
+/// @return true if file @p fileName starts with the binary PGM magic number
+bool isPGM(const string& fileName)
+{
+	ifstream file(fileName.c_str(), ios::binary);
+	char magic[2];
+	return file.read(magic, 2) && (magic[0] == 'P') && (magic[1] == '5');
+}
+
+/// Sums of the pixels of the integration area, weighted by their coordinates within the area
+struct PixelSums
+{
+	double sum;
+	double sumX, sumY;
+	double sumX2, sumY2;
+};
+
+/**
+* Sums of the @p n pixels of @p row, weighted by 1, x and x², x being the index in the row.
+* Integer sums are exact, and are vectorized by the compiler
+*/
+inline void rowSums(const unsigned short* row, int n, unsigned long long& sum, unsigned long long& sumX, unsigned long long& sumX2)
+{
+	unsigned long long s = 0, sx = 0, sx2 = 0;
+	for (int i = 0; i < n; i++)
+	{
+		const unsigned long long pixel = row[i];
+		s += pixel;
+		sx += pixel*i;
+		sx2 += pixel*i*i;
+	}
+	sum = s;
+	sumX = sx;
+	sumX2 = sx2;
+}
+
+/// Sums of the pixels of @p image within [@p x0, @p x1) x [@p y0, @p y1)
+PixelSums pixelSums(const BeamImage& image, int x0, int x1, int y0, int y1)
+{
+	PixelSums sums = {0., 0., 0., 0., 0.};
+	for (int y = y0; y < y1; y++)
+	{
+		unsigned long long sum, sumX, sumX2;
+		rowSums(&image.pixels[y*image.width + x0], x1 - x0, sum, sumX, sumX2);
+		const double dy = y - y0;
+		sums.sum += sum;
+		sums.sumX += sumX;
+		sums.sumX2 += sumX2;
+		sums.sumY += dy*sum;
+		sums.sumY2 += sqr(dy)*sum;
+	}
+
+	return sums;
+}
+
+}
+
+/////////////////////////////////////////////////
+// BeamImage
+
+bool BeamImage::loadPGM(const string& fileName)
+{
+	ifstream file(fileName.c_str(), ios::binary);
+	position = pixelSize = 0.;
+
+	string magic, widthToken, heightToken, maxToken;
+	if (!readToken(file, magic, *this) || (magic != "P5") || !readToken(file, widthToken, *this) ||
+	    !readToken(file, heightToken, *this) || !readToken(file, maxToken, *this))
+	{
+		cerr << "BeamImage: " << fileName << " is not a binary PGM file" << endl;
+		return false;
+	}
+
+	width = atoi(widthToken.c_str());
+	height = atoi(heightToken.c_str());
+	const int maxValue = atoi(maxToken.c_str());
+	if ((width <= 0) || (height <= 0) || (maxValue <= 0) || (maxValue > 65535))
+	{
+		cerr << "BeamImage: wrong PGM header in " << fileName << endl;
+		return false;
+	}
+
+	// The pixels are read in place in the pixel buffer, and expanded to 16 bit host order
+	const int n = width*height;
+	const int depth = (maxValue < 256) ? 1 : 2;
+	pixels.resize(n);
+	unsigned char* bytes = reinterpret_cast<unsigned char*>(&pixels[0]);
+	if (!file.read(reinterpret_cast<char*>(bytes), streamsize(n)*depth))
+	{
+		cerr << "BeamImage: " << fileName << " is too short" << endl;
+		return false;
+	}
+
+	if (depth == 1)
+		for (int i = n - 1; i >= 0; i--)
+			pixels[i] = bytes[i];
+	else
+		for (int i = 0; i < n; i++)
+			pixels[i] = (bytes[2*i] << 8) | bytes[2*i + 1];
+
+	return true;
+}
+
+bool BeamImage::loadRaw(const string& fileName, int width, int height)
+{
+	ifstream file(fileName.c_str(), ios::binary);
+	this->width = width;
+	this->height = height;
+	position = pixelSize = 0.;
+
+	const int n = ::max(0, width*height);
+	pixels.resize(n);
+	unsigned char* bytes = reinterpret_cast<unsigned char*>(&pixels[0]);
+	if ((n == 0) || !file.read(reinterpret_cast<char*>(bytes), streamsize(n)*2))
+	{
+		cerr << "BeamImage: cannot read " << width << "x" << height << " pixels from " << fileName << endl;
+		return false;
+	}
+
+	for (int i = 0; i < n; i++)
+		pixels[i] = bytes[2*i] | (bytes[2*i + 1] << 8);
+
+	return true;
+}
+
+/////////////////////////////////////////////////
+// BeamImageAnalysis
+
+BeamImageAnalysis::BeamImageAnalysis()
+	: m_background(-1.)
+	, m_apertureFactor(3.)
+	, m_pixelSize(0.)
+	, m_rawWidth(0)
+	, m_rawHeight(0)
+	, m_threadCount(Parallel::threadCount())
+{}
+
+BeamMoments BeamImageAnalysis::analyze(const BeamImage& image) const
+{
+	BeamMoments moments;
+	moments.valid = false;
+	moments.position = image.position;
+	moments.centroidX = moments.centroidY = 0.;
+	moments.radiusX = moments.radiusY = 0.;
+	moments.background = 0.;
+
+	const int width = image.width;
+	const int height = image.height;
+	const double pixelSize = (image.pixelSize > 0.) ? image.pixelSize : m_pixelSize;
+	if ((width <= 0) || (height <= 0) || (int(image.pixels.size()) < width*height) || !(pixelSize > 0.))
+		return moments;
+
+	// Background: mean of the four corners
+	double background = m_background;
+	if (background < 0.)
+	{
+		const int cornerWidth = ::max(1, width/10);
+		const int cornerHeight = ::max(1, height/10);
+		const int x0[2] = {0, width - cornerWidth};
+		const int y0[2] = {0, height - cornerHeight};
+		double sum = 0.;
+		for (int i = 0; i < 2; i++)
+			for (int j = 0; j < 2; j++)
+				sum += pixelSums(image, x0[i], x0[i] + cornerWidth, y0[j], y0[j] + cornerHeight).sum;
+		background = sum/(4.*cornerWidth*cornerHeight);
+	}
+	moments.background = background;
+
+	// The background is subtracted from the integer sums, using the sums of the coordinates over the area
+	int x0 = 0, x1 = width, y0 = 0, y1 = height;
+	for (int iteration = 0; iteration < maxIterations; iteration++)
+	{
+		const PixelSums sums = pixelSums(image, x0, x1, y0, y1);
+		const double nx = x1 - x0, ny = y1 - y0;
+		const double sum = sums.sum - background*nx*ny;
+		if (!(sum > 0.))
+		{
+			moments.valid = false;
+			return moments;
+		}
+
+		const double meanX = (sums.sumX - background*ny*nx*(nx - 1.)/2.)/sum;
+		const double meanY = (sums.sumY - background*nx*ny*(ny - 1.)/2.)/sum;
+		const double varianceX = (sums.sumX2 - background*ny*(nx - 1.)*nx*(2.*nx - 1.)/6.)/sum - sqr(meanX);
+		const double varianceY = (sums.sumY2 - background*nx*(ny - 1.)*ny*(2.*ny - 1.)/6.)/sum - sqr(meanY);
+		if (!(varianceX > 0.) || !(varianceY > 0.))
+		{
+			moments.valid = false;
+			return moments;
+		}
+
+		// Pixel i covers [i, i + 1)
+		const double centroidX = x0 + meanX + 0.5;
+		const double centroidY = y0 + meanY + 0.5;
+		moments.centroidX = centroidX*pixelSize;
+		moments.centroidY = centroidY*pixelSize;
+		moments.radiusX = 2.*sqrt(varianceX)*pixelSize;
+		moments.radiusY = 2.*sqrt(varianceY)*pixelSize;
+		moments.valid = true;
+		if (!(m_apertureFactor > 0.))
+			break;
+
+		// Next integration area: apertureFactor times the diameter 4σ, centered on the centroid
+		const double halfX = 2.*m_apertureFactor*sqrt(varianceX);
+		const double halfY = 2.*m_apertureFactor*sqrt(varianceY);
+		const int newX0 = ::max(0, int(floor(centroidX - halfX)));
+		const int newX1 = ::min(width, int(ceil(centroidX + halfX)));
+		const int newY0 = ::max(0, int(floor(centroidY - halfY)));
+		const int newY1 = ::min(height, int(ceil(centroidY + halfY)));
+		if ((newX0 == x0) && (newX1 == x1) && (newY0 == y0) && (newY1 == y1))
+			break;
+		if ((newX1 <= newX0) || (newY1 <= newY0))
+		{
+			moments.valid = false;
+			return moments;
+		}
+		x0 = newX0;
+		x1 = newX1;
+		y0 = newY0;
+		y1 = newY1;
+	}
+
+	return moments;
+}
+
+bool BeamImageAnalysis::run(const vector<string>& fileNames, const vector<double>& positions)
+{
+	m_results.assign(fileNames.size(), BeamMoments());
+
+	// Each thread loads its frames in its own pixel buffer
+	const int nThreads = ::max(1, ::min(m_threadCount, int(fileNames.size())));
+	vector<BeamImage> images(nThreads);
+	auto measure = [&](int index, int thread)
+	{
+		BeamImage& image = images[thread];
+		const string& fileName = fileNames[index];
+		bool loaded;
+		if ((m_rawWidth > 0) && (m_rawHeight > 0) && !isPGM(fileName))
+			loaded = image.loadRaw(fileName, m_rawWidth, m_rawHeight);
+		else
+			loaded = image.loadPGM(fileName);
+		if (index < int(positions.size()))
+			image.position = positions[index];
+
+		// A frame that cannot be loaded is measured as an empty frame
+		m_results[index] = loaded ? analyze(image) : analyze(BeamImage());
+	};
+	Parallel::forEach(fileNames.size(), measure, nThreads);
+
+	bool success = true;
+	for (unsigned int i = 0; i < m_results.size(); i++)
+		if (!m_results[i].valid)
+		{
+			cerr << "BeamImageAnalysis: cannot measure the beam in " << fileNames[i] << endl;
+			success = false;
+		}
+
+	return success;
+}
+
+int BeamImageAnalysis::addToFit(Fit& fit) const
+{
+	// Radii are converted to the data type of the fit
+	const double unit = Fit::radius(1., fit.dataType());
+	int count = 0;
+	for (vector<BeamMoments>::const_iterator it = m_results.begin(); it != m_results.end(); it++)
+	{
+		if (!it->valid)
+			continue;
+
+		if (fit.orientation() == Horizontal)
+			fit.addData(it->position, it->radiusX/unit, Horizontal);
+		else if (fit.orientation() == Vertical)
+			fit.addData(it->position, it->radiusY/unit, Vertical);
+		else if (fit.orientation() == Ellipsoidal)
+		{
+			fit.addData(it->position, it->radiusX/unit, Horizontal);
+			fit.setData(fit.size() - 1, it->position, it->radiusY/unit, Vertical);
+		}
+		else
+			fit.addData(it->position, sqrt((sqr(it->radiusX) + sqr(it->radiusY))/2.)/unit, Spherical);
+		count++;
+	}
+
+	return count;
+}
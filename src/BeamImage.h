@@ -0,0 +1,128 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BEAMIMAGE_H
+#define BEAMIMAGE_H
+
+#include <string>
+#include <vector>
+
+class Fit;
+
+/**
+* Camera frame of a beam, with 16 bit pixels stored row by row.
+* Binary PGM files (P5, 8 or 16 bit) may carry metadata in their header comments, in meters:
+* @code
+* # position 0.0125
+* # pixel_size 5.5e-6
+* @endcode
+* Metadata that are not given are 0.
+*/
+struct BeamImage
+{
+	BeamImage() : width(0), height(0), position(0.), pixelSize(0.) {}
+
+	/// Load the binary PGM file @p fileName. The pixel buffer is reused. @return false if the file cannot be read or is not a binary PGM file
+	bool loadPGM(const std::string& fileName);
+	/// Load the raw file @p fileName of @p width x @p height little endian 16 bit pixels. @return false if the file is too short
+	bool loadRaw(const std::string& fileName, int width, int height);
+
+	int width;
+	int height;
+	std::vector<unsigned short> pixels;
+	/// Position of the camera along the beam
+	double position;
+	/// Size of a pixel
+	double pixelSize;
+};
+
+/// Beam centroid and widths measured by BeamImageAnalysis on a frame
+struct BeamMoments
+{
+	/// false if the frame could not be loaded, or has no beam above the background
+	bool valid;
+	/// Position of the frame along the beam
+	double position;
+	/// Centroid, from the top left corner of the frame
+	double centroidX;
+	double centroidY;
+	/// Beam radius at 1/e² on each axis, i.e. twice the standard deviation of the intensity
+	double radiusX;
+	double radiusY;
+	/// Background level subtracted from the pixels
+	double background;
+};
+
+/**
+* Beam widths measured on camera frames by the second moments of the intensity distribution (ISO 11146).
+* The background is subtracted from the pixels, and the moments are computed within an integration area
+* centered on the centroid, whose size is apertureFactor() times the beam diameter on each axis.
+* This area is iterated from the whole frame until it is stable.
+* Pixel sums are exact integer reductions on rows of pixels, that the compiler can vectorize, and frames are
+* loaded and analyzed in parallel, each thread reusing its own frame buffer.
+*/
+class BeamImageAnalysis
+{
+public:
+	BeamImageAnalysis();
+
+public:
+	/// Background level, in pixel counts. If negative (the default), it is the mean of the four corners of each frame, a tenth of the frame wide and high
+	double background() const { return m_background; }
+	void setBackground(double background) { m_background = background; }
+	/// Size of the integration area, in beam diameters. Defaults to 3
+	double apertureFactor() const { return m_apertureFactor; }
+	void setApertureFactor(double apertureFactor) { m_apertureFactor = apertureFactor; }
+	/// Pixel size of the frames whose file has no pixel size
+	double pixelSize() const { return m_pixelSize; }
+	void setPixelSize(double pixelSize) { m_pixelSize = pixelSize; }
+	/// Size of raw frames. Files that are not PGM files are read as raw frames of this size
+	void setRawSize(int width, int height) { m_rawWidth = width; m_rawHeight = height; }
+	/// Maximum number of threads used by run()
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+
+	/// Measure the beam on @p image. @return the moments, that are not valid if the frame has no beam above the background
+	BeamMoments analyze(const BeamImage& image) const;
+	/**
+	* Load and measure the frames @p fileNames. If @p positions is not empty, it gives the position of each frame,
+	* instead of the position of the file metadata.
+	* @return false if a frame could not be measured
+	*/
+	bool run(const std::vector<std::string>& fileNames, const std::vector<double>& positions = std::vector<double>());
+	/// @return the moments of each frame of the last run, in the order of the files
+	const std::vector<BeamMoments>& results() const { return m_results; }
+	/**
+	* Add the radii of the valid frames of the last run to @p fit, converted to the data type of the fit.
+	* A spherical fit gets the generalized radius sqrt((radiusX² + radiusY²)/2), an ellipsoidal fit both radii.
+	* @return the number of points added
+	*/
+	int addToFit(Fit& fit) const;
+
+private:
+	double m_background;
+	double m_apertureFactor;
+	double m_pixelSize;
+	int m_rawWidth;
+	int m_rawHeight;
+	int m_threadCount;
+
+	// Results
+	std::vector<BeamMoments> m_results;
+};
+
+#endif
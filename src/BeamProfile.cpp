@@ -0,0 +1,99 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "BeamProfile.h"
+
+#include <cmath>
+
+using namespace std;
+
+BeamProfile::BeamProfile(const Beam& beam, Orientation orientation)
+{
+	addBeam(beam, orientation);
+}
+
+int BeamProfile::addBeam(const Beam& beam, Orientation orientation)
+{
+	m_waist.push_back(beam.waist(orientation));
+	m_waistPosition.push_back(beam.waistPosition(orientation));
+	m_rayleigh.push_back(beam.rayleigh(orientation));
+
+	return m_waist.size() - 1;
+}
+
+void BeamProfile::clear()
+{
+	m_waist.clear();
+	m_waistPosition.clear();
+	m_rayleigh.clear();
+}
+
+bool BeamProfile::evaluate(Property::Type property, int beamIndex, const double* z, int n, double* result) const
+{
+	const double w0 = m_waist[beamIndex];
+	const double zw = m_waistPosition[beamIndex];
+	const double z0 = m_rayleigh[beamIndex];
+
+	// Each loop only depends on the constants above, so that it can be vectorized
+	if (property == Property::BeamRadius)
+		for (int i = 0; i < n; i++)
+		{
+			const double zred = (z[i] - zw)/z0;
+			result[i] = w0*sqrt(1. + zred*zred);
+		}
+	else if (property == Property::BeamDiameter)
+		for (int i = 0; i < n; i++)
+		{
+			const double zred = (z[i] - zw)/z0;
+			result[i] = 2.*(w0*sqrt(1. + zred*zred));
+		}
+	else if (property == Property::BeamCurvature)
+		for (int i = 0; i < n; i++)
+		{
+			const double zred = (z[i] - zw)/z0;
+			result[i] = (z[i] - zw)*(1. + 1./(zred*zred));
+		}
+	else if (property == Property::BeamGouyPhase)
+		for (int i = 0; i < n; i++)
+			result[i] = atan((z[i] - zw)/z0);
+	else if (property == Property::BeamDistanceToWaist)
+		for (int i = 0; i < n; i++)
+			result[i] = z[i] - zw;
+	else
+		return false;
+
+	return true;
+}
+
+bool BeamProfile::evaluate(Property::Type property, const double* z, int n, double* result) const
+{
+	for (int b = 0; b < nBeams(); b++)
+		if (!evaluate(property, b, z, n, result + b*n))
+			return false;
+
+	return true;
+}
+
+void BeamProfile::q(int beamIndex, const double* z, int n, complex<double>* result) const
+{
+	const double zw = m_waistPosition[beamIndex];
+	const double z0 = m_rayleigh[beamIndex];
+
+	for (int i = 0; i < n; i++)
+		result[i] = complex<double>(z[i] - zw, z0);
+}
@@ -0,0 +1,67 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BEAMPROFILE_H
+#define BEAMPROFILE_H
+
+#include "GaussianBeam.h"
+
+#include <complex>
+#include <vector>
+
+/**
+* Batched evaluation of the position dependent properties of one or several beams.
+* The waist, waist position and Rayleigh range of each beam are computed once when the
+* beam is added, and stored in contiguous arrays (one array per constant). The evaluation
+* loops only involve these constants and the position array, so that the compiler can vectorize them.
+* Results are identical to the corresponding Beam functions.
+*/
+class BeamProfile
+{
+public:
+	/// Construct an empty profile
+	BeamProfile() {}
+	/// Construct a profile of beam @p beam on orientation @p orientation
+	BeamProfile(const Beam& beam, Orientation orientation = Horizontal);
+
+public:
+	/// Add beam @p beam on orientation @p orientation. @return the index of the beam in the profile
+	int addBeam(const Beam& beam, Orientation orientation = Horizontal);
+	/// Remove all beams
+	void clear();
+	/// @return the number of beams
+	int nBeams() const { return m_waist.size(); }
+
+	/**
+	* Evaluate @p property of beam @p beamIndex at the @p n positions @p z, and store it in @p result.
+	* @p property is one of Property::BeamRadius, BeamDiameter, BeamCurvature, BeamGouyPhase and BeamDistanceToWaist.
+	* @return false if @p property is not position dependent
+	*/
+	bool evaluate(Property::Type property, int beamIndex, const double* z, int n, double* result) const;
+	/// Evaluate @p property of all beams. The property of beam b at position z[i] is stored in result[b*n + i]
+	bool evaluate(Property::Type property, const double* z, int n, double* result) const;
+	/// Compute the complex beam parameter of beam @p beamIndex at the @p n positions @p z
+	void q(int beamIndex, const double* z, int n, std::complex<double>* result) const;
+
+private:
+	std::vector<double> m_waist;
+	std::vector<double> m_waistPosition;
+	std::vector<double> m_rayleigh;
+};
+
+#endif
@@ -0,0 +1,313 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "CatalogSearch.h"
+#include "OpticsBench.h"
+#include "OpticsFunction.h"
+#include "Parallel.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+
+namespace
+{
+
+/**
+* Range [@p lo, @p hi] of the rayleigh range of a beam of rayleigh range @p rayleigh after a thin lens of focal @p focal,
+* when the distance from the beam waist to the lens is within [@p sMin, @p sMax]
+*/
+void lensRayleighRange(double rayleigh, double focal, double sMin, double sMax, double& lo, double& hi)
+{
+	// z0' = z0/((1 - s/f)^2 + (z0/f)^2), whose denominator is convex in s and minimal for s = f
+	const double denMin = sqr(1. - sMin/focal) + sqr(rayleigh/focal);
+	const double denMax = sqr(1. - sMax/focal) + sqr(rayleigh/focal);
+	const double lowest = ((focal >= sMin) && (focal <= sMax)) ? sqr(rayleigh/focal) : ::min(denMin, denMax);
+	lo = rayleigh/::max(denMin, denMax);
+	hi = rayleigh/lowest;
+}
+
+/// Upper bound of the overlap of two coaxial beams whose rayleigh ranges are within [@p lo1, @p hi1] and [@p lo2, @p hi2]
+double rayleighOverlapBound(double lo1, double hi1, double lo2, double hi2)
+{
+	// The overlap of beams with coinciding waists is 4*z1*z2/(z1 + z2)^2, and decreases with the rayleigh range mismatch
+	double ratio = 1.;
+	if (hi1 < lo2)
+		ratio = hi1/lo2;
+	else if (hi2 < lo1)
+		ratio = hi2/lo1;
+
+	return 4.*ratio/sqr(1. + ratio);
+}
+
+}
+
+LensCatalogSearch::LensCatalogSearch(const OpticsBench& bench)
+	: m_bench(bench)
+	, m_resultCount(10)
+	, m_minimumOverlap(bench.targetOverlap())
+	, m_seed(0)
+	, m_sampleCount(20000)
+	, m_threadCount(Parallel::threadCount())
+	, m_pruning(true)
+	, m_nEvaluated(0)
+	, m_nPruned(0)
+{}
+
+bool LensCatalogSearch::setCatalog(int index, const vector<double>& focals)
+{
+	double focal;
+	if ((index < 0) || (index >= m_bench.nOptics()) || !OpticsParameter::get(m_bench.optics(index), OpticsParameter::Focal, focal))
+	{
+		cerr << "LensCatalogSearch: optics " << index << " is not a lens" << endl;
+		return false;
+	}
+
+	vector<double> catalog;
+	for (vector<double>::const_iterator it = focals.begin(); it != focals.end(); it++)
+		if (*it != 0.)
+			catalog.push_back(*it);
+
+	if (catalog.empty())
+	{
+		cerr << "LensCatalogSearch: empty catalog for optics " << index << endl;
+		return false;
+	}
+
+	m_catalogs[index] = catalog;
+	return true;
+}
+
+int LensCatalogSearch::nCombinations() const
+{
+	if (m_catalogs.empty())
+		return 0;
+
+	int count = 1;
+	for (map<int, vector<double> >::const_iterator it = m_catalogs.begin(); it != m_catalogs.end(); it++)
+		count *= it->second.size();
+
+	return count;
+}
+
+vector<double> LensCatalogSearch::combination(int combination) const
+{
+	// The last lens varies fastest
+	vector<double> focals(m_catalogs.size());
+	int slot = m_catalogs.size() - 1;
+	for (map<int, vector<double> >::const_reverse_iterator it = m_catalogs.rbegin(); it != m_catalogs.rend(); it++, slot--)
+	{
+		focals[slot] = it->second[combination % it->second.size()];
+		combination /= it->second.size();
+	}
+
+	return focals;
+}
+
+double LensCatalogSearch::overlapBound(const vector<double>& focals) const
+{
+	// The bound holds for a spherical bench whose optics are one or two thin lenses
+	const int nLenses = m_bench.nOptics() - 1;
+	const Beam* input = m_bench.beam(0);
+	const Beam* target = m_bench.targetBeam();
+	if ((nLenses < 1) || (nLenses > 2) || !m_bench.isSpherical() ||
+	    (input->index() != target->index()) || (input->M2() != target->M2()))
+		return 1.;
+
+	vector<double> focal(nLenses), minPos(nLenses), maxPos(nLenses);
+	for (int i = 0; i < nLenses; i++)
+	{
+		const Optics* optics = m_bench.optics(i + 1);
+		if ((optics->type() != LensType) || (optics->orientation() != Spherical) || (optics->width() != 0.) ||
+		    optics->relativeLockParent() || !optics->relativeLockChildren().empty())
+			return 1.;
+
+		map<int, vector<double> >::const_iterator catalog = m_catalogs.find(i + 1);
+		focal[i] = dynamic_cast<const Lens*>(optics)->focal();
+		if (catalog != m_catalogs.end())
+			focal[i] = focals[distance(m_catalogs.begin(), catalog)];
+
+		minPos[i] = maxPos[i] = optics->position();
+		if (!optics->absoluteLock())
+		{
+			minPos[i] = m_bench.leftBoundary();
+			maxPos[i] = m_bench.rightBoundary();
+		}
+	}
+
+	const double inputRayleigh = input->rayleigh();
+	const double inputWaist = input->waistPosition();
+	const double targetRayleigh = target->rayleigh();
+	const double targetWaist = target->waistPosition();
+
+	// One lens: image of the input beam against the target beam
+	double lo, hi;
+	if (nLenses == 1)
+	{
+		lensRayleighRange(inputRayleigh, focal[0], minPos[0] - inputWaist, maxPos[0] - inputWaist, lo, hi);
+		return rayleighOverlapBound(lo, hi, targetRayleigh, targetRayleigh);
+	}
+
+	// Two lenses: image of the input beam by the first lens against the image of the target beam by the second lens,
+	// both taken between the lenses. Either lens may come first
+	double bound = 0.;
+	for (int first = 0; first < 2; first++)
+	{
+		const int second = 1 - first;
+		double targetLo, targetHi;
+		lensRayleighRange(inputRayleigh, focal[first], minPos[first] - inputWaist, maxPos[first] - inputWaist, lo, hi);
+		lensRayleighRange(targetRayleigh, focal[second], targetWaist - maxPos[second], targetWaist - minPos[second], targetLo, targetHi);
+		bound = ::max(bound, rayleighOverlapBound(lo, hi, targetLo, targetHi));
+	}
+
+	return bound;
+}
+
+CatalogDesign LensCatalogSearch::evaluate(int combination) const
+{
+	CatalogDesign design;
+	design.combination = combination;
+	design.focals = this->combination(combination);
+
+	vector<Optics*> optics = m_bench.cloneOptics();
+	int slot = 0;
+	for (map<int, vector<double> >::const_iterator it = m_catalogs.begin(); it != m_catalogs.end(); it++, slot++)
+		OpticsParameter::set(optics[it->first], OpticsParameter::Focal, design.focals[slot]);
+
+	// Same search as the magic waist of the bench
+	OpticsFunction function(optics, m_bench.wavelength());
+	function.setOverlapBeam(*m_bench.targetBeam());
+	function.setCheckLock(true);
+	vector<double> positions = function.currentPosition();
+
+	vector<double> lower = positions;
+	vector<double> upper = positions;
+	bool movable = false;
+	for (unsigned int i = 0; i < optics.size(); i++)
+		if (!optics[i]->relativeLockTreeAbsoluteLock())
+		{
+			lower[i] = m_bench.leftBoundary();
+			upper[i] = m_bench.rightBoundary();
+			movable = true;
+		}
+
+	if (movable)
+	{
+		function.setBounds(lower, upper);
+		function.setGoal(m_minimumOverlap);
+		function.setSeed(m_seed);
+		function.setSampleCount(m_sampleCount);
+		function.setThreadCount(1);
+		positions = function.absoluteMaximum();
+	}
+	design.overlap = function.value(positions);
+	if (!(design.overlap >= 0.))
+		design.overlap = 0.;
+
+	for (unsigned int i = 0; i < optics.size(); i++)
+		optics[i]->setPosition(positions[i], true);
+
+	design.length = 0.;
+	if (optics.size() > 1)
+	{
+		double begin = optics[1]->position(), end = optics[1]->endPosition();
+		for (unsigned int i = 2; i < optics.size(); i++)
+		{
+			begin = ::min(begin, optics[i]->position());
+			end = ::max(end, optics[i]->endPosition());
+		}
+		design.length = end - begin;
+	}
+
+	for (unsigned int i = 0; i < optics.size(); i++)
+	{
+		design.positions.push_back(optics[i]->position());
+		delete optics[i];
+	}
+
+	return design;
+}
+
+bool LensCatalogSearch::better(const CatalogDesign& design1, const CatalogDesign& design2) const
+{
+	const bool reached1 = design1.overlap >= m_minimumOverlap;
+	const bool reached2 = design2.overlap >= m_minimumOverlap;
+	if (reached1 != reached2)
+		return reached1;
+	if (reached1 && (design1.length != design2.length))
+		return design1.length < design2.length;
+	if (design1.overlap != design2.overlap)
+		return design1.overlap > design2.overlap;
+
+	return design1.combination < design2.combination;
+}
+
+bool LensCatalogSearch::run()
+{
+	m_results.clear();
+	m_nEvaluated = m_nPruned = 0;
+
+	const int count = nCombinations();
+	if (count == 0)
+		return false;
+
+	// Most promising combinations first, so that the best designs are found early
+	vector<pair<double, int> > order(count);
+	for (int c = 0; c < count; c++)
+		order[c] = make_pair(-overlapBound(combination(c)), c);
+	sort(order.begin(), order.end());
+
+	// A pruned combination can neither reach the minimum overlap nor beat the overlap of the current results,
+	// hence the results do not depend on the evaluation order. Only the pruning statistics do.
+	mutex resultMutex;
+	auto search = [&](int index, int /*thread*/)
+	{
+		const double bound = -order[index].first + 1e-9;
+		{
+			lock_guard<mutex> lock(resultMutex);
+			if (m_pruning && (bound < m_minimumOverlap) && (int(m_results.size()) == m_resultCount))
+			{
+				double worstOverlap = 1.;
+				for (vector<CatalogDesign>::const_iterator it = m_results.begin(); it != m_results.end(); it++)
+					worstOverlap = ::min(worstOverlap, it->overlap);
+				if (bound < worstOverlap)
+				{
+					m_nPruned++;
+					return;
+				}
+			}
+		}
+
+		const CatalogDesign design = evaluate(order[index].second);
+
+		lock_guard<mutex> lock(resultMutex);
+		m_nEvaluated++;
+		vector<CatalogDesign>::iterator position = m_results.begin();
+		while ((position != m_results.end()) && better(*position, design))
+			position++;
+		m_results.insert(position, design);
+		if (int(m_results.size()) > m_resultCount)
+			m_results.pop_back();
+	};
+	Parallel::forEach(count, search, m_threadCount);
+
+	return true;
+}
@@ -0,0 +1,105 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CATALOGSEARCH_H
+#define CATALOGSEARCH_H
+
+#include <map>
+#include <vector>
+
+class OpticsBench;
+
+/// Lens design found by LensCatalogSearch
+struct CatalogDesign
+{
+	/// Combination index, see LensCatalogSearch::combination
+	int combination;
+	/// Focal of each lens that has a catalog, in the order of the lens indices
+	std::vector<double> focals;
+	/// Position of each optics of the bench, after the optimization
+	std::vector<double> positions;
+	/// Overlap with the target beam
+	double overlap;
+	/// Distance between the first and the last lens, including their width
+	double length;
+};
+
+/**
+* Search of the best lens focals among catalogs of available focals.
+* Each combination of catalog focals is evaluated by a magic waist search of the optics positions.
+* Before being evaluated, a combination is bounded by an analytic upper bound of its overlap, computed from the
+* Rayleigh range magnification of thin lenses within the bench boundaries. Combinations are evaluated in parallel,
+* by decreasing bound, and are skipped as soon as their bound cannot beat the designs already found.
+* This upper bound is only available for spherical benches made of one or two lenses, other benches are searched exhaustively.
+* The designs that reach the minimum overlap come first, the shortest first. The other designs follow, by decreasing overlap.
+* The results for a given seed do not depend on the number of threads.
+*/
+class LensCatalogSearch
+{
+public:
+	LensCatalogSearch(const OpticsBench& bench);
+
+public:
+	/// Choose the focal of lens @p index among @p focals. @return false if optics @p index is not a lens or if @p focals is empty
+	bool setCatalog(int index, const std::vector<double>& focals);
+	/// @return the number of focal combinations
+	int nCombinations() const;
+	/// @return the focals of combination @p combination, in the order of the lens indices
+	std::vector<double> combination(int combination) const;
+
+	/// Number of designs returned by results()
+	void setResultCount(int resultCount) { m_resultCount = resultCount > 0 ? resultCount : 1; }
+	/// Overlap that a design has to reach to be ranked by length. Defaults to the bench target overlap
+	void setMinimumOverlap(double minimumOverlap) { m_minimumOverlap = minimumOverlap; }
+	/// Seed and number of random samples of the magic waist search of each combination
+	void setSeed(unsigned int seed) { m_seed = seed; }
+	void setSampleCount(int sampleCount) { m_sampleCount = sampleCount; }
+	/// Maximum number of threads used by run()
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+	/// Skip the combinations whose overlap bound cannot beat the designs already found. Enabled by default
+	void setPruning(bool pruning) { m_pruning = pruning; }
+
+	/// Search the best combinations. @return false if no catalog is set
+	bool run();
+	/// @return the best designs found by the last run
+	const std::vector<CatalogDesign>& results() const { return m_results; }
+	/// @return the number of combinations that were evaluated or skipped during the last run
+	int nEvaluated() const { return m_nEvaluated; }
+	int nPruned() const { return m_nPruned; }
+
+private:
+	double overlapBound(const std::vector<double>& focals) const;
+	CatalogDesign evaluate(int combination) const;
+	bool better(const CatalogDesign& design1, const CatalogDesign& design2) const;
+
+private:
+	const OpticsBench& m_bench;
+	std::map<int, std::vector<double> > m_catalogs;
+	int m_resultCount;
+	double m_minimumOverlap;
+	unsigned int m_seed;
+	int m_sampleCount;
+	int m_threadCount;
+	bool m_pruning;
+
+	// Results
+	std::vector<CatalogDesign> m_results;
+	int m_nEvaluated, m_nPruned;
+};
+
+#endif
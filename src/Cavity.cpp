@@ -18,8 +18,8 @@
 
 #include "Cavity.h"
 #include "OpticsBench.h"
+#include "Trace.h"
 
-#include <iostream>
 #include <algorithm>
 
 using namespace std;
@@ -66,15 +66,19 @@ void Cavity::computeMatrix() const
 	for (list<const ABCD*>::const_iterator it = m_opticsList.begin(); it != m_opticsList.end(); lastIt = it++)
 	{
 		if (lastIt != m_opticsList.end())
+		{
 			m_matrix *= FreeSpace((*it)->position() - (*(lastIt))->endPosition(), (*lastIt)->endPosition());
-		cerr << " Cavity ABCD added free space = " << m_matrix << endl;
+			TRACE(Trace::Debug, " Cavity ABCD added free space = " << m_matrix);
+		}
 		m_matrix *= *(*it);
-		cerr << " Cavity ABCD added optics = " << m_matrix << endl;
+		TRACE(Trace::Debug, " Cavity ABCD added optics = " << m_matrix);
 	}
 	// Free space that closes the cavity
 	if (lastIt != m_opticsList.end())
+	{
 		m_matrix *= FreeSpace(m_closingFreeSpace, (*lastIt)->endPosition());
-		cerr << " Cavity ABCD added last free space = " << m_matrix << endl;
+		TRACE(Trace::Debug, " Cavity ABCD added last free space = " << m_matrix);
+	}
 
 	m_dirty = false;
 }
@@ -99,8 +103,9 @@ bool Cavity::isStable() const
 
 	// Stability criterion: stable if the eigen beam q parameter of
 	// the ABCD matrix has a non-zero imaginary part
-	cerr << "Delta = " << delta() << endl;
-	return delta() < 0.;
+	const double cavityDelta = delta();
+	TRACE(Trace::Debug, "Delta = " << cavityDelta);
+	return cavityDelta < 0.;
 }
 
 const Beam* Cavity::eigenBeam(double wavelength, int index) const
@@ -0,0 +1,229 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "FitBootstrap.h"
+#include "Parallel.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+namespace
+{
+
+/// Number of resamples fitted with the same random generator
+const int chunkSize = 64;
+
+/// @return the value at probability @p p of the sorted values @p values, interpolated between ranks
+double quantile(const vector<double>& values, double p)
+{
+	const double rank = p*(values.size() - 1);
+	const int i = ::min(int(rank), int(values.size()) - 1);
+	if (i + 1 >= int(values.size()))
+		return values[i];
+
+	return values[i] + (rank - i)*(values[i + 1] - values[i]);
+}
+
+/// @return the quantile at probability @p p of the standard normal distribution
+double normalQuantile(double p)
+{
+	double lo = -40., hi = 40.;
+	for (int i = 0; i < 100; i++)
+	{
+		const double z = (lo + hi)/2.;
+		if (0.5*erfc(-z/M_SQRT2) < p)
+			lo = z;
+		else
+			hi = z;
+	}
+
+	return (lo + hi)/2.;
+}
+
+}
+
+/// Fit buffers of a thread, reused from one resample to the next
+struct FitBootstrap::Buffers
+{
+	Fit::ResampleBuffers fit;
+	vector<int> draws;
+	vector<double> parameters;
+};
+
+FitBootstrap::FitBootstrap(const Fit& fit)
+	: m_fit(fit)
+	, m_method(BootstrapResampling)
+	, m_sampleCount(2000)
+	, m_seed(0)
+	, m_confidence(0.95)
+	, m_threadCount(Parallel::threadCount())
+	, m_nSamples(0)
+	, m_nFailed(0)
+{
+	m_M2.value = m_M2.lower = m_M2.upper = 1.;
+	m_M2.deviation = 0.;
+}
+
+FitInterval FitBootstrap::interval(Orientation orientation, int parameter) const
+{
+	for (unsigned int o = 0; o < m_orientations.size(); o++)
+		if ((m_orientations[o] == orientation) || ((orientation == Spherical) && (m_orientations.size() == 1)))
+			return m_intervals[2*o + parameter];
+
+	FitInterval none = {0., 0., 0., 0.};
+	return none;
+}
+
+bool FitBootstrap::run(double wavelength)
+{
+	m_orientations.clear();
+	m_intervals.clear();
+	m_M2.value = m_M2.lower = m_M2.upper = 1.;
+	m_M2.deviation = 0.;
+	m_nSamples = m_nFailed = 0;
+
+	if (!(m_confidence > 0.) || !(m_confidence < 1.))
+		return false;
+
+	// Fit on all points, whose result is the reference candidate of the resample fits
+	Fit fit(m_fit);
+	Beam beam(wavelength);
+	fit.applyFit(beam);
+
+	vector<Orientation> orientations;
+	if (fit.orientation() != Ellipsoidal)
+		orientations.push_back(fit.orientation());
+	else
+	{
+		orientations.push_back(Horizontal);
+		orientations.push_back(Vertical);
+	}
+	for (unsigned int o = 0; o < orientations.size(); o++)
+		if (fit.fitAvailable(orientations[o]))
+			m_orientations.push_back(orientations[o]);
+	const int nWorkspaces = m_orientations.size();
+	if (nWorkspaces == 0)
+		return false;
+
+	const vector<double> fitted = fit.parameters();
+	const int nPar = fitted.size();
+	const bool fitM2 = nPar > 2*nWorkspaces;
+
+	// Entries with a value on a fitted orientation
+	vector<int> entries;
+	for (int i = 0; i < fit.size(); i++)
+	{
+		bool found = false;
+		for (int w = 0; w < nWorkspaces; w++)
+			found = found || (fit.radius(i, m_orientations[w]) > Utils::epsilon);
+		if (found)
+			entries.push_back(i);
+	}
+	const int nEntries = entries.size();
+	const int nSamples = (m_method == JackknifeResampling) ? nEntries : m_sampleCount;
+	if (nSamples <= 0)
+		return false;
+
+	const int nChunks = (nSamples + chunkSize - 1)/chunkSize;
+	const int nThreads = ::max(1, ::min(m_threadCount, nChunks));
+	vector<Buffers> buffers(nThreads);
+	vector<double> samples(nSamples*nPar);
+	vector<char> valid(nSamples, 0);
+	auto resample = [&](int c, int thread)
+	{
+		Buffers& buffer = buffers[thread];
+		seed_seq sequence = {m_seed, (unsigned int)(c)};
+		mt19937 random(sequence);
+
+		const int stop = ::min(nSamples, (c + 1)*chunkSize);
+		for (int s = c*chunkSize; s < stop; s++)
+		{
+			buffer.draws.clear();
+			if (m_method == JackknifeResampling)
+			{
+				for (int i = 0; i < nEntries; i++)
+					if (i != s)
+						buffer.draws.push_back(entries[i]);
+			}
+			else
+				for (int i = 0; i < nEntries; i++)
+					buffer.draws.push_back(entries[::min(int((random() + 0.5)/4294967296.*nEntries), nEntries - 1)]);
+
+			if (!Fit::fitResample(fit, wavelength, buffer.draws, buffer.parameters, buffer.fit))
+				continue;
+
+			for (int k = 0; k < nPar; k++)
+				samples[s*nPar + k] = buffer.parameters[k];
+			valid[s] = 1;
+		}
+	};
+	Parallel::forEach(nChunks, resample, nThreads);
+
+	for (int s = 0; s < nSamples; s++)
+		if (valid[s])
+			m_nSamples++;
+	m_nFailed = nSamples - m_nSamples;
+	if (m_nSamples == 0)
+		return false;
+
+	// Intervals, from the valid resamples in resample order
+	const double z = normalQuantile((1. + m_confidence)/2.);
+	vector<double> values;
+	for (int k = 0; k < nPar; k++)
+	{
+		values.clear();
+		double mean = 0.;
+		for (int s = 0; s < nSamples; s++)
+			if (valid[s])
+			{
+				values.push_back(samples[s*nPar + k]);
+				mean += samples[s*nPar + k];
+			}
+		mean /= m_nSamples;
+		double sumSquares = 0.;
+		for (vector<double>::const_iterator it = values.begin(); it != values.end(); it++)
+			sumSquares += sqr(*it - mean);
+
+		FitInterval interval;
+		interval.value = fitted[k];
+		if (m_method == JackknifeResampling)
+		{
+			interval.deviation = sqrt(sumSquares*(m_nSamples - 1)/m_nSamples);
+			interval.lower = interval.value - z*interval.deviation;
+			interval.upper = interval.value + z*interval.deviation;
+		}
+		else
+		{
+			interval.deviation = (m_nSamples > 1) ? sqrt(sumSquares/(m_nSamples - 1)) : 0.;
+			sort(values.begin(), values.end());
+			interval.lower = quantile(values, (1. - m_confidence)/2.);
+			interval.upper = quantile(values, (1. + m_confidence)/2.);
+		}
+
+		if (fitM2 && (k == nPar - 1))
+			m_M2 = interval;
+		else
+			m_intervals.push_back(interval);
+	}
+
+	return true;
+}
@@ -0,0 +1,113 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef FITBOOTSTRAP_H
+#define FITBOOTSTRAP_H
+
+#include "GaussianFit.h"
+
+#include <vector>
+
+/**
+* Resampling method of FitBootstrap
+* - BootstrapResampling: draw as many points as the fit has, with replacement. Percentile intervals
+* - JackknifeResampling: leave each point out in turn. Normal intervals around the fitted value
+*/
+enum FitResampling {BootstrapResampling, JackknifeResampling};
+
+/// Confidence interval of a fitted parameter, see FitBootstrap
+struct FitInterval
+{
+	/// Value fitted on all points
+	double value;
+	/// Bounds of the confidence interval
+	double lower;
+	double upper;
+	/// Standard error
+	double deviation;
+};
+
+/**
+* Confidence intervals of the waist, waist position and M² of a Fit, estimated by refitting resampled data.
+* The points of the fit are entries: both values of an ellipsoidal entry are drawn together.
+* Each resample is fitted by Fit::fitResample, with the same non linear and M² fits as Fit::applyFit, from two initial
+* guesses: the result on all points and the linear fit of the resample.
+* Resamples are fitted by chunks, each chunk having its own random generator seeded by the seed and the chunk index,
+* and each thread reusing its own fit buffers. The results for a given seed do not depend on the number of threads.
+* Resamples whose data cannot be fitted, e.g. whose points all have the same position, are not counted.
+* The fit is copied when run() starts, and is not modified.
+*/
+class FitBootstrap
+{
+public:
+	FitBootstrap(const Fit& fit);
+
+public:
+	/// Resampling method. Defaults to BootstrapResampling
+	FitResampling method() const { return m_method; }
+	void setMethod(FitResampling method) { m_method = method; }
+	/// Number of bootstrap resamples drawn by run(). The jackknife has one resample per point
+	int sampleCount() const { return m_sampleCount; }
+	void setSampleCount(int sampleCount) { m_sampleCount = sampleCount; }
+	/// A given seed always gives the same results
+	unsigned int seed() const { return m_seed; }
+	void setSeed(unsigned int seed) { m_seed = seed; }
+	/// Probability that the confidence intervals contain the parameters. Defaults to 0.95
+	double confidence() const { return m_confidence; }
+	void setConfidence(double confidence) { m_confidence = confidence; }
+	/// Maximum number of threads used by run()
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+
+	/**
+	* Fit the resamples of the fit data, for a beam of wavelength @p wavelength, and compute the confidence intervals.
+	* @return false if the fit has no result, if the confidence is not within (0, 1), or if no resample could be fitted
+	*/
+	bool run(double wavelength);
+
+	// Results of the last run
+
+	/// Waist and waist position on @p orientation. Spherical stands for the only fitted orientation
+	FitInterval waist(Orientation orientation = Spherical) const { return interval(orientation, 0); }
+	FitInterval waistPosition(Orientation orientation = Spherical) const { return interval(orientation, 1); }
+	/// M², which is exactly 1 if M² is not fitted
+	FitInterval M2() const { return m_M2; }
+	/// Number of resamples fitted, and number of resamples that could not be fitted
+	int nSamples() const { return m_nSamples; }
+	int nFailed() const { return m_nFailed; }
+
+private:
+	struct Buffers;
+	FitInterval interval(Orientation orientation, int parameter) const;
+
+private:
+	const Fit& m_fit;
+	FitResampling m_method;
+	int m_sampleCount;
+	unsigned int m_seed;
+	double m_confidence;
+	int m_threadCount;
+
+	// Results
+	std::vector<Orientation> m_orientations;
+	std::vector<FitInterval> m_intervals;
+	FitInterval m_M2;
+	int m_nSamples;
+	int m_nFailed;
+};
+
+#endif
@@ -17,34 +17,97 @@
 */
 
 #include "Function.h"
+#include "Parallel.h"
+#include "Trace.h"
 #include "Utils.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <random>
 
 using namespace std;
 
+namespace
+{
+
+// Parameters of the strong Wolfe conditions: sufficient decrease, and slope reduction, which has to be tight for conjugate gradient
+const double wolfeDecrease = 1e-4;
+const double wolfeCurvature = 0.1;
+
+/// @return the left hand side of @p constraint at @p x
+double constraintValue(const LinearConstraint& constraint, const vector<double>& x)
+{
+	double result = 0.;
+	for (unsigned int k = 0; k < constraint.indices.size(); k++)
+		if (constraint.indices[k] < int(x.size()))
+			result += constraint.coefficients[k]*x[constraint.indices[k]];
+
+	return result;
+}
+
+/// @return the violation of @p constraint below which it is considered satisfied, and above which it is not active
+double constraintTolerance(const LinearConstraint& constraint)
+{
+	return 1e-10*(1. + fabs(constraint.bound));
+}
+
+}
+
+/////////////////////////////////////////////////
+// OptimizationStats class
+
+OptimizationStats& OptimizationStats::operator+=(const OptimizationStats& other)
+{
+	evaluations += other.evaluations;
+	gradientEvaluations += other.gradientEvaluations;
+	lineSearches += other.lineSearches;
+	bracketExpansions += other.bracketExpansions;
+	iterations += other.iterations;
+
+	return *this;
+}
+
 /////////////////////////////////////////////////
 // Function class
 
 Function::Function()
+	: m_lineGradientStep(0.)
+	, m_lineMinStep(-numeric_limits<double>::infinity())
+	, m_lineMaxStep(numeric_limits<double>::infinity())
+	, m_goal(0.)
+	, m_hasGoal(false)
+	, m_seed(0)
+	, m_sampleCount(500000)
+	, m_threadCount(Parallel::threadCount())
+	, m_control(0)
+	, m_iterationLimit(250)
+	, m_stopValue(0.)
+	, m_hasStopValue(false)
 {
 }
 
 vector<double> Function::gradient(const vector<double>& x) const
+{
+	vector<double> result;
+	gradient(x, result);
+	return result;
+}
+
+void Function::gradient(const vector<double>& x, vector<double>& result) const
 {
 	double epsilon = 1e-6;
-	vector<double> xlocal = x;
-	vector<double> grad(x.size());
+	m_gradientPoint = x;
+	result.resize(x.size());
+	const double value0 = value(x);
 
 	for (unsigned int i = 0; i < x.size(); i++)
 	{
-		xlocal[i] += epsilon;
-		grad[i] = (value(xlocal) - value(x))/epsilon;
-		xlocal[i] -= epsilon;
+		m_gradientPoint[i] += epsilon;
+		result[i] = (value(m_gradientPoint) - value0)/epsilon;
+		m_gradientPoint[i] = x[i];
 	}
-
-	return grad;
 }
 
 vector<double> Function::curvature(const vector<double>& x) const
@@ -52,15 +115,16 @@ vector<double> Function::curvature(const vector<double>& x) const
 	double epsilon = 1e-6;
 	vector<double> xlocal = x;
 	vector<double> curv(x.size());
+	const double value0 = value(x);
 
 	for (unsigned int i = 0; i < x.size(); i++)
 	{
-		curv[i] = -2.*value(x);
+		curv[i] = -2.*value0;
 		xlocal[i] += epsilon;
 		curv[i] += value(xlocal);
 		xlocal[i] -= 2.*epsilon;
 		curv[i] += value(xlocal);
-		xlocal[i] += epsilon;
+		xlocal[i] = x[i];
 		curv[i] /= sqr(epsilon);
 	}
 
@@ -69,18 +133,46 @@ vector<double> Function::curvature(const vector<double>& x) const
 
 void Function::setLine(const vector<double>& point, const vector<double>& direction) const
 {
+	// Assignments reuse the storage of the buffers
 	m_linePoint = point;
 	m_lineDirection = direction;
+	m_lineTrial.resize(point.size());
+	m_lineGradientStep = numeric_limits<double>::quiet_NaN();
+	m_lineMinStep = -numeric_limits<double>::infinity();
+	m_lineMaxStep = numeric_limits<double>::infinity();
 }
 
-vector<double> Function::lineParametric(double x) const
+const vector<double>& Function::linePoint(double x) const
 {
-	return m_linePoint + m_lineDirection*x;
+	x = ::min(m_lineMaxStep, ::max(m_lineMinStep, x));
+	for (unsigned int i = 0; i < m_lineTrial.size(); i++)
+		m_lineTrial[i] = m_linePoint[i] + m_lineDirection[i]*x;
+
+	return m_lineTrial;
 }
 
 double Function::lineValue(double x) const
 {
-	return (m_min ? 1.: -1.)*value(lineParametric(x));
+	return (m_min ? 1.: -1.)*evaluate(linePoint(x));
+}
+
+double Function::lineSlope(double x) const
+{
+	m_stats.gradientEvaluations++;
+	gradient(linePoint(x), m_lineGradient);
+	m_lineGradientStep = x;
+
+	double slope = 0.;
+	for (unsigned int i = 0; i < m_lineGradient.size(); i++)
+		slope += m_lineGradient[i]*m_lineDirection[i];
+
+	return (m_min ? 1.: -1.)*slope;
+}
+
+double Function::evaluate(const vector<double>& x) const
+{
+	m_stats.evaluations++;
+	return value(x);
 }
 
 vector<double> Function::lineExtremum(const vector<double>& x, const vector<double>& u, bool min) const
@@ -89,70 +181,593 @@ vector<double> Function::lineExtremum(const vector<double>& x, const vector<doub
 	setExtremumType(min);
 	setLine(x, u);
 
-	double start = 0.;
-	double stop = 1.;
-	cerr << "  Initial guess " << start << " to  " << stop << endl;
-	vector<double> bracket = bracketMinimum(start, stop);
-	cerr << "  Improved guess " << bracket[0] << " to " << bracket[2] << " by " << bracket[1] << endl;
+	const double value0 = lineValue(0.);
+	const double slope0 = hasGradient() ? lineSlope(0.) : 0.;
+	const double step = lineSearch(value0, slope0, 1.);
+	TRACE(Trace::Debug, "  Extremum at " << step);
 
-	double xmin = brent(bracket);
-	cerr << "  Minimum at " << xmin << endl;
-	cerr << "  Min val = " << lineValue(xmin) << " " << lineValue(xmin + 0.01) << " " << lineValue(xmin - 0.01) << endl;
-	return lineParametric(xmin);
+	return linePoint(step);
+}
+
+double Function::lineSearch(double value0, double slope0, double step) const
+{
+	m_stats.lineSearches++;
+
+	step = ::min(step, m_lineMaxStep);
+	if (!(step > 0.))
+		return 0.;
+
+	// Fall back to values only where the gradient is misleading, e.g. on kinks of the function
+	if (hasGradient())
+	{
+		const double wolfeStep = wolfeSearch(value0, slope0, step);
+		if (wolfeStep != 0.)
+			return wolfeStep;
+	}
+
+	double a = 0., b = step, c;
+	bracketMinimum(a, b, c);
+	TRACE(Trace::Debug, "  Bracket " << a << " to " << c << " by " << b);
+	return ::min(m_lineMaxStep, ::max(m_lineMinStep, brent(a, c, b)));
 }
 
 vector<double> Function::localExtremum(const vector<double>& x, bool min) const
 {
-	// Conjugate gradient algorithm
+	// Conjugate gradient algorithm, with Polak-Ribière updates.
+	// With constraints, the steepest descent is projected on the active constraints, and the conjugation restarts
+	// each time the active set changes. The buffers are allocated once, so that iterations do not allocate memory.
 
-	static const int maxIter = 250;
+	const int maxIter = m_iterationLimit;
 	m_success = true;
 	setExtremumType(min);
+	const double sign = min ? 1. : -1.;
+	const int n = x.size();
+	const bool constrained = !m_constraints.empty();
 	vector<double> position = x;
-	vector<double> direction(x.size(), 0.);
-	vector<double> oldGrad;
+	if (constrained && !makeFeasible(position))
+	{
+		m_success = false;
+		return x;
+	}
+
+	vector<double> direction(n, 0.);
+	vector<double> grad, descent(n), oldDescent(n);
+	double oldNorm = 0.;
+	double step = 1.;
 	int i;
 
-	for (i = 0; (value(position) < 0.99999) && (i < maxIter); i++)
+	m_active.clear();
+	double current = evaluate(position);
+	if (!reached(current))
+	{
+		gradient(position, grad);
+		m_stats.gradientEvaluations++;
+	}
+	for (i = 0; !reached(current) && (i < maxIter) && !cancelled(); i++)
 	{
-		cerr << "Iteration " << i << endl;
-		// Compute the optimization direction
-		vector<double> grad = gradient(position);
-		double beta = 0.;
-		if (!oldGrad.empty())
+		m_stats.iterations++;
+		TRACE(Trace::Debug, "Iteration " << i);
+		// Compute the optimization direction, along which the signed function decreases
+		for (int j = 0; j < n; j++)
+			descent[j] = -sign*grad[j];
+		if (constrained)
+		{
+			::swap(m_previousActive, m_active);
+			projectedDescent(position, descent);
+			if (m_active != m_previousActive)
+				oldNorm = 0.;
+		}
+
+		double norm = 0., beta = 0.;
+		for (int j = 0; j < n; j++)
+			norm += sqr(descent[j]);
+		// The constraints block the whole gradient, up to rounding errors
+		if (constrained && (norm <= 1e-20*Utils::scalar(grad, grad)))
+			break;
+		if (oldNorm > 0.)
 		{
-			//beta = Utils::scalar(grad, grad)/Utils::scalar(oldGrad, oldGrad); // Fletcher-Reeves
-			beta = Utils::scalar(grad, grad - oldGrad)/Utils::scalar(oldGrad, oldGrad); // Polak-Ribière
-			//beta = Utils::scalar(grad, grad - oldGrad)/Utils::scalar(direction, grad - oldGrad); // Hestenes-Stiefel
-			beta = ::max(0., beta);
+			for (int j = 0; j < n; j++)
+				beta += descent[j]*(descent[j] - oldDescent[j]);
+			beta = ::max(0., beta/oldNorm);
 		}
-		direction =  beta*direction - grad;
-		oldGrad = grad;
 
-		cerr << " Direction : " << direction[0] << " " << direction[1] << " " << direction[2] << endl;
+		for (int j = 0; j < n; j++)
+			direction[j] = beta*direction[j] + descent[j];
+		// Remove the rounding errors that drive the conjugate direction out of the active constraints
+		if (constrained && (beta > 0.))
+			projectOnActive(direction);
+		double slope = 0.;
+		for (int j = 0; j < n; j++)
+			slope += sign*grad[j]*direction[j];
+		// Restart along the steepest descent if the conjugate direction does not descend
+		if (hasGradient() && (slope >= 0.) && (beta > 0.))
+		{
+			beta = 0.;
+			slope = 0.;
+			for (int j = 0; j < n; j++)
+			{
+				direction[j] = descent[j];
+				slope += sign*grad[j]*direction[j];
+			}
+		}
+		::swap(oldDescent, descent);
+		oldNorm = norm;
+
+		// Search along the line. The initial step of the Wolfe search is the previous step, which is
+		// well scaled for conjugate directions, and the unit step after a restart
+		setLine(position, direction);
+		if (constrained)
+			feasibleSteps(position, direction, m_lineMinStep, m_lineMaxStep);
+		step = lineSearch(sign*current, slope, (beta > 0.) ? step : 1.);
+		for (int j = 0; j < n; j++)
+			position[j] += step*direction[j];
+
+		const double previous = current;
+		current = evaluate(position);
+		TRACE(Trace::Debug, " Value : " << current);
+		reportValue(current, min);
+		reportProgress(double(i + 1)/double(maxIter));
+
+		// The Wolfe search usually ends on a point where the gradient is already known
+		if (step == m_lineGradientStep)
+			::swap(grad, m_lineGradient);
+		else
+		{
+			gradient(position, grad);
+			m_stats.gradientEvaluations++;
+		}
 
-		position = lineMaximum(position, direction);
-		for (vector<double>::iterator it = position.begin(); it != position.end(); it++)
-			cerr << " Pos " << (*it) << endl;
-		cerr << " Value : " << value(position) << endl;
+		// Without progress, restart along the steepest descent, and stop if it does not progress either
+		if (!(sign*current < sign*previous))
+		{
+			if (beta == 0.)
+				break;
+			oldNorm = 0.;
+		}
 	}
 
-	if (i == maxIter)
+	// Without stop value, a local extremum is a success
+	if ((!reached(current) && (fabs(stopValue()) < numeric_limits<double>::infinity())) || cancelled())
 		m_success = false;
 
 	return position;
 }
 
+double Function::stopValue() const
+{
+	if (m_hasStopValue)
+		return m_stopValue;
+	if (m_hasGoal)
+		return m_goal;
+
+	return m_min ? -numeric_limits<double>::infinity() : 0.99999;
+}
+
+bool Function::makeFeasible(vector<double>& x) const
+{
+	// Successive projections on the violated constraints, which converge for any non empty intersection
+	static const int maxSweeps = 1000;
+
+	for (int sweep = 0; sweep < maxSweeps; sweep++)
+	{
+		bool feasible = true;
+		for (vector<LinearConstraint>::const_iterator constraint = m_constraints.begin(); constraint != m_constraints.end(); constraint++)
+		{
+			const double violation = constraintValue(*constraint, x) - constraint->bound;
+			if (violation <= 0.)
+				continue;
+			feasible = feasible && (violation <= constraintTolerance(*constraint));
+
+			double norm = 0.;
+			for (unsigned int k = 0; k < constraint->indices.size(); k++)
+				if (constraint->indices[k] < int(x.size()))
+					norm += sqr(constraint->coefficients[k]);
+			if (norm == 0.)
+				return false;
+			for (unsigned int k = 0; k < constraint->indices.size(); k++)
+				if (constraint->indices[k] < int(x.size()))
+					x[constraint->indices[k]] -= violation/norm*constraint->coefficients[k];
+		}
+		if (feasible)
+			return true;
+	}
+
+	cerr << "Function: no point satisfies the constraints" << endl;
+	return false;
+}
+
+void Function::projectedDescent(const vector<double>& x, vector<double>& descent) const
+{
+	// Orthonormal basis Q of the normals of the active constraints, A^T = Q R, built by Gram-Schmidt.
+	// The projected direction is d = descent - Q Q^T descent, and the multipliers solve R lambda = Q^T descent.
+	// A negative multiplier means that the function decreases away from its constraint, which is then released.
+	const int n = x.size();
+	const int nConstraints = m_constraints.size();
+
+	m_active.clear();
+	for (int c = 0; c < nConstraints; c++)
+		if (m_constraints[c].bound - constraintValue(m_constraints[c], x) <= constraintTolerance(m_constraints[c]))
+			m_active.push_back(c);
+
+	for (;;)
+	{
+		// Factorize the normals, skipping the ones that depend on the previous normals
+		const int size = m_active.size();
+		int k = 0;
+		m_activeBasis.resize(n*size);
+		m_activeFactor.resize(size*size);
+		for (int a = 0; a < size; a++)
+		{
+			const LinearConstraint& constraint = m_constraints[m_active[a]];
+			double* q = &m_activeBasis[n*k];
+			fill(q, q + n, 0.);
+			double normalNorm = 0.;
+			for (unsigned int t = 0; t < constraint.indices.size(); t++)
+				if (constraint.indices[t] < n)
+				{
+					q[constraint.indices[t]] += constraint.coefficients[t];
+					normalNorm += sqr(constraint.coefficients[t]);
+				}
+
+			for (int j = 0; j < k; j++)
+			{
+				const double* qj = &m_activeBasis[n*j];
+				double r = 0.;
+				for (int l = 0; l < n; l++)
+					r += qj[l]*q[l];
+				for (int l = 0; l < n; l++)
+					q[l] -= r*qj[l];
+				m_activeFactor[j*size + k] = r;
+			}
+
+			double norm = 0.;
+			for (int l = 0; l < n; l++)
+				norm += sqr(q[l]);
+			norm = sqrt(norm);
+			if (norm <= 1e-10*sqrt(normalNorm))
+				continue;
+			for (int l = 0; l < n; l++)
+				q[l] /= norm;
+			m_activeFactor[k*size + k] = norm;
+			m_active[k++] = m_active[a];
+		}
+		m_active.resize(k);
+		if (k == 0)
+			return;
+
+		// Multipliers, by back substitution
+		m_multipliers.resize(k);
+		for (int j = k - 1; j >= 0; j--)
+		{
+			const double* qj = &m_activeBasis[n*j];
+			double lambda = 0.;
+			for (int l = 0; l < n; l++)
+				lambda += qj[l]*descent[l];
+			for (int m = j + 1; m < k; m++)
+				lambda -= m_activeFactor[j*size + m]*m_multipliers[m];
+			m_multipliers[j] = lambda/m_activeFactor[j*size + j];
+		}
+
+		int released = -1;
+		for (int j = 0; j < k; j++)
+			if ((m_multipliers[j] < 0.) && ((released < 0) || (m_multipliers[j] < m_multipliers[released])))
+				released = j;
+		if (released < 0)
+			break;
+		m_active.erase(m_active.begin() + released);
+	}
+
+	projectOnActive(descent);
+}
+
+void Function::projectOnActive(vector<double>& v) const
+{
+	const int n = v.size();
+	for (unsigned int j = 0; j < m_active.size(); j++)
+	{
+		const double* qj = &m_activeBasis[n*j];
+		double r = 0.;
+		for (int l = 0; l < n; l++)
+			r += qj[l]*v[l];
+		for (int l = 0; l < n; l++)
+			v[l] -= r*qj[l];
+	}
+}
+
+void Function::feasibleSteps(const vector<double>& x, const vector<double>& direction, double& minStep, double& maxStep) const
+{
+	double directionNorm = 0.;
+	for (unsigned int l = 0; l < direction.size(); l++)
+		directionNorm += sqr(direction[l]);
+	directionNorm = sqrt(directionNorm);
+
+	minStep = -numeric_limits<double>::infinity();
+	maxStep = numeric_limits<double>::infinity();
+	unsigned int a = 0;
+	for (int c = 0; c < int(m_constraints.size()); c++)
+	{
+		// Active constraints are parallel to the direction
+		if ((a < m_active.size()) && (m_active[a] == c))
+		{
+			a++;
+			continue;
+		}
+
+		const LinearConstraint& constraint = m_constraints[c];
+		double normalNorm = 0.;
+		for (unsigned int k = 0; k < constraint.coefficients.size(); k++)
+			normalNorm += sqr(constraint.coefficients[k]);
+		const double rate = constraintValue(constraint, direction);
+		const double slack = ::max(0., constraint.bound - constraintValue(constraint, x));
+		if (rate > 1e-12*directionNorm*sqrt(normalNorm))
+			maxStep = ::min(maxStep, slack/rate);
+		else if (rate < -1e-12*directionNorm*sqrt(normalNorm))
+			minStep = ::max(minStep, slack/rate);
+	}
+}
+
+void Function::setBounds(const vector<double>& lower, const vector<double>& upper)
+{
+	m_lowerBound = lower;
+	m_upperBound = upper;
+}
+
+void Function::reportProgress(double progress) const
+{
+	if (!m_control)
+		return;
+
+	double current = m_control->progress;
+	while ((progress > current) && !m_control->progress.compare_exchange_weak(current, progress));
+}
+
+void Function::reportValue(double value, bool min) const
+{
+	if (!m_control)
+		return;
+
+	double best = m_control->best;
+	while ((min ? (value < best) : (value > best)) && !m_control->best.compare_exchange_weak(best, value));
+}
+
+void Function::project(vector<double>& x) const
+{
+	for (unsigned int i = 0; i < x.size(); i++)
+		x[i] = ::min(m_upperBound[i], ::max(m_lowerBound[i], x[i]));
+}
+
 vector<double> Function::absoluteExtremum(bool min) const
 {
-	m_success = true;
+	// Random points are drawn by chunks handed out to the threads. Each chunk has its own
+	// random stream seeded by the chunk index, and the search stops at the first chunk reaching the goal
+	static const int chunkSize = 1024;
+	static const int nPolish = 8;
+
+	m_success = false;
 	setExtremumType(min);
-	/// @todo
-	return vector<double>(2);
+
+	const int n = m_lowerBound.size();
+	if ((n == 0) || (m_upperBound.size() != m_lowerBound.size()) || (m_sampleCount <= 0))
+		return m_lowerBound;
+
+	// Scores are signed according to the type of extremum searched, lower is better
+	const double sign = min ? 1. : -1.;
+	const double goalScore = sign*m_goal;
+	const int nChunks = (m_sampleCount + chunkSize - 1)/chunkSize;
+
+	// Each thread works on its own copy of the function
+	vector<const Function*> functions(1, this);
+	for (int thread = 1; thread < ::min(m_threadCount, nChunks); thread++)
+	{
+		Function* function = clone();
+		if (!function)
+			break;
+		function->resetStats();
+		functions.push_back(function);
+	}
+	const int nThreads = functions.size();
+
+	vector<double> chunkScore(nChunks, numeric_limits<double>::infinity());
+	vector<vector<double> > chunkPoint(nChunks);
+	atomic<int> firstHit(nChunks);
+	atomic<int> chunksDone(0);
+	atomic<int> samples(0);
+
+	auto sample = [&](int chunk, int thread)
+	{
+		const Function* function = functions[thread];
+		seed_seq sequence = {m_seed, (unsigned int)(chunk)};
+		mt19937 random(sequence);
+		vector<double> x(n);
+
+		const int stop = ::min(m_sampleCount, (chunk + 1)*chunkSize);
+		int s;
+		for (s = chunk*chunkSize; (s < stop) && (chunk < firstHit) && !cancelled(); s++)
+		{
+			for (int i = 0; i < n; i++)
+				x[i] = m_lowerBound[i] + (random() + 0.5)/4294967296.*(m_upperBound[i] - m_lowerBound[i]);
+
+			const double value = sign*function->value(x);
+			if (value < chunkScore[chunk])
+			{
+				chunkScore[chunk] = value;
+				chunkPoint[chunk] = x;
+			}
+
+			if (m_hasGoal && (value <= goalScore))
+			{
+				int hit = firstHit;
+				while ((chunk < hit) && !firstHit.compare_exchange_weak(hit, chunk));
+				s++;
+				break;
+			}
+		}
+		samples += s - chunk*chunkSize;
+
+		if (!chunkPoint[chunk].empty())
+			reportValue(sign*chunkScore[chunk], min);
+		reportProgress(double(++chunksDone)/double(nChunks));
+	};
+	Parallel::forEach(nChunks, sample, nThreads);
+	m_stats.evaluations += samples;
+
+	// Candidates for polishing: the point reaching the goal, or the best points of the best chunks
+	vector<pair<double, int> > ranking;
+	if (firstHit < nChunks)
+		ranking.push_back(make_pair(chunkScore[firstHit], int(firstHit)));
+	else
+	{
+		for (int chunk = 0; chunk < nChunks; chunk++)
+			if (!chunkPoint[chunk].empty())
+				ranking.push_back(make_pair(chunkScore[chunk], chunk));
+		sort(ranking.begin(), ranking.end());
+		ranking.resize(::min(int(ranking.size()), nPolish));
+	}
+
+	if (ranking.empty())
+	{
+		for (unsigned int thread = 1; thread < functions.size(); thread++)
+			delete functions[thread];
+		return m_lowerBound;
+	}
+
+	vector<double> polishedScore(ranking.size());
+	vector<vector<double> > polishedPoint(ranking.size());
+	auto polish = [&](int candidate, int thread)
+	{
+		const Function* function = functions[thread];
+		vector<double>& x = polishedPoint[candidate];
+		x = chunkPoint[ranking[candidate].second];
+		polishedScore[candidate] = ranking[candidate].first;
+
+		vector<double> local = function->localExtremum(x, min);
+		project(local);
+		const double value = sign*function->value(local);
+		if (value < polishedScore[candidate])
+		{
+			polishedScore[candidate] = value;
+			x = local;
+		}
+	};
+	Parallel::forEach(ranking.size(), polish, nThreads);
+
+	for (unsigned int thread = 1; thread < functions.size(); thread++)
+	{
+		m_stats += functions[thread]->stats();
+		delete functions[thread];
+	}
+
+	int best = 0;
+	for (unsigned int candidate = 1; candidate < ranking.size(); candidate++)
+		if (polishedScore[candidate] < polishedScore[best])
+			best = candidate;
+
+	m_success = (!m_hasGoal || (polishedScore[best] <= goalScore)) && !cancelled();
+	return polishedPoint[best];
+}
+
+/**
+* Search a step satisfying the strong Wolfe conditions (Nocedal and Wright, Numerical Optimization, algorithm 3.5):
+* a sufficient decrease of the signed function, and a small enough slope. @p value0 and @p slope0 are the value and
+* slope at step 0, and @p step the initial step. @return 0 if no step decreases the function
+*/
+double Function::wolfeSearch(double value0, double slope0, double step) const
+{
+	static const int maxIter = 30;
+	static const double expansion = 2.;
+
+	if (!(slope0 < 0.))
+		return 0.;
+
+	double previous = 0., previousValue = value0, previousSlope = slope0;
+	for (int iter = 0; (iter < maxIter) && (step < numeric_limits<double>::max()/expansion); iter++)
+	{
+		const double value = lineValue(step);
+		if ((value > value0 + wolfeDecrease*step*slope0) || ((iter > 0) && (value >= previousValue)) || !(value == value))
+			return wolfeZoom(value0, slope0, previous, previousValue, previousSlope, step, value, 0., false);
+
+		const double slope = lineSlope(step);
+		if (fabs(slope) <= -wolfeCurvature*slope0)
+			return step;
+		if (slope >= 0.)
+			return wolfeZoom(value0, slope0, step, value, slope, previous, previousValue, previousSlope, true);
+		// The function still decreases where the step reaches a constraint
+		if (step >= m_lineMaxStep)
+			return step;
+
+		m_stats.bracketExpansions++;
+		previous = step;
+		previousValue = value;
+		previousSlope = slope;
+		step = ::min(step*expansion, m_lineMaxStep);
+	}
+
+	return previous;
+}
+
+/**
+* Zoom phase of the strong Wolfe search (Nocedal and Wright, algorithm 3.6). The step lies between @p lo and @p hi,
+* @p lo being the best step found so far, which satisfies the sufficient decrease condition
+*/
+double Function::wolfeZoom(double value0, double slope0, double lo, double valueLo, double slopeLo,
+                           double hi, double valueHi, double slopeHi, bool hiSlopeKnown) const
+{
+	static const int maxIter = 30;
+	static const double safeguard = 0.1;
+
+	for (int iter = 0; (iter < maxIter) && (fabs(hi - lo) > 1e-12*::max(1., fabs(lo))); iter++)
+	{
+		// Cubic interpolation if both slopes are known, quadratic otherwise, kept away from the interval ends
+		const double width = hi - lo;
+		double step = lo + 0.5*width;
+		if (hiSlopeKnown)
+		{
+			const double d1 = slopeLo + slopeHi - 3.*(valueLo - valueHi)/(lo - hi);
+			const double discriminant = sqr(d1) - slopeLo*slopeHi;
+			if (discriminant >= 0.)
+			{
+				const double d2 = sign(width)*sqrt(discriminant);
+				step = hi - width*(slopeHi + d2 - d1)/(slopeHi - slopeLo + 2.*d2);
+			}
+		}
+		else if (valueHi == valueHi)
+		{
+			const double denominator = 2.*(valueHi - valueLo - slopeLo*width);
+			if (denominator > 0.)
+				step = lo - slopeLo*sqr(width)/denominator;
+		}
+		if (!(step == step) || ((step - lo)/width < safeguard) || ((hi - step)/width < safeguard))
+			step = lo + 0.5*width;
+
+		const double value = lineValue(step);
+		if ((value > value0 + wolfeDecrease*step*slope0) || (value >= valueLo) || !(value == value))
+		{
+			hi = step;
+			valueHi = value;
+			hiSlopeKnown = false;
+			continue;
+		}
+
+		const double slope = lineSlope(step);
+		if (fabs(slope) <= -wolfeCurvature*slope0)
+			return step;
+		if (slope*width >= 0.)
+		{
+			hi = lo;
+			valueHi = valueLo;
+			slopeHi = slopeLo;
+			hiSlopeKnown = true;
+		}
+		lo = step;
+		valueLo = value;
+		slopeLo = slope;
+	}
+
+	return lo;
 }
 
 /// @todo replace this by a random search
-vector<double> Function::bracketMinimum(double start, double stop) const
+void Function::bracketMinimum(double& a, double& b, double& c) const
 {
 	static const double golden = 1.618033988749894848;
 	static const double epsilon = 1e-20;
@@ -160,9 +775,6 @@ vector<double> Function::bracketMinimum(double start, double stop) const
 
 	double ulim, fu;
 
-	double a = start;
-	double b = stop;
-
 	double fa = lineValue(a);
 	double fb = lineValue(b);
 	if (fb > fa)
@@ -171,11 +783,12 @@ vector<double> Function::bracketMinimum(double start, double stop) const
 		::swap(fb, fa);
 	}
 
-	double c = b + golden*(b - a);
+	c = b + golden*(b - a);
 	double fc = lineValue(c);
 
 	while (fb > fc)
 	{
+		m_stats.bracketExpansions++;
 		double r = (b - a)*(fb - fc);
 		double q = (b - c)*(fb - fa);
 		double u = b - ((b - c)*q - (b - a)*r)/(2.0*::max(double(fabs(q-r)), epsilon)*sign(q-r));
@@ -219,16 +832,10 @@ vector<double> Function::bracketMinimum(double start, double stop) const
 		a = b; b = c; c = u;
 		fa = fb; fb = fc; fc = fu;
 	}
-
-	vector<double> result;
-	result.push_back(a);
-	result.push_back(b);
-	result.push_back(c);
-
-	return result;
 }
 
-double Function::brent(const vector<double>& bracket) const
+/// Brent's minimization of lineValue on the bracket [@p a, @p b] (or [@p b, @p a]), starting from @p x
+double Function::brent(double a, double b, double x) const
 {
 	static const double maxIter = 100;
 	static const double cGolden = 0.3819660112501051518; // (3 - sqrt(5))/2
@@ -237,11 +844,11 @@ double Function::brent(const vector<double>& bracket) const
 
 	double e = 0.;
 
-	double a = ::min(bracket[0], bracket[2]);
-	double b = ::max(bracket[0], bracket[2]);
+	if (a > b)
+		::swap(a, b);
 
-	double d, fu, fv, fw, fx, u, v, w, x;
-	x = w = v = bracket[1];
+	double d, fu, fv, fw, fx, u, v, w;
+	w = v = x;
 	fw = fv = fx = lineValue(x);
 
 	for (int iter = 0; iter < maxIter; iter++)
@@ -19,8 +19,52 @@
 #ifndef FUNCTION_H
 #define FUNCTION_H
 
+#include <atomic>
 #include <vector>
 
+/**
+* State shared between an optimization running on a worker thread and its owner.
+* The optimization reports its progress, which increases from 0 to 1, and the best function value found so far,
+* and stops as soon as possible when cancel is set. The owner initializes best to a value
+* worse than any expected result.
+*/
+struct OptimizationControl
+{
+	OptimizationControl() : cancel(false), progress(0.), best(0.) {}
+
+	std::atomic<bool> cancel;
+	std::atomic<double> progress;
+	std::atomic<double> best;
+};
+
+/**
+* Work done by the search functions of Function, accumulated until reset
+*/
+struct OptimizationStats
+{
+	OptimizationStats() : evaluations(0), gradientEvaluations(0), lineSearches(0), bracketExpansions(0), iterations(0) {}
+	OptimizationStats& operator+=(const OptimizationStats& other);
+
+	/// Number of function evaluations
+	int evaluations;
+	/// Number of gradient evaluations
+	int gradientEvaluations;
+	/// Number of line searches
+	int lineSearches;
+	/// Number of expansion steps when bracketing a line minimum, or when searching a step satisfying the Wolfe conditions
+	int bracketExpansions;
+	/// Number of conjugate gradient iterations
+	int iterations;
+};
+
+/// Linear inequality constraint: the sum of coefficients[k]*x[indices[k]] is at most bound
+struct LinearConstraint
+{
+	std::vector<int> indices;
+	std::vector<double> coefficients;
+	double bound;
+};
+
 /**
 * Generic class for multi-dimensionnal functions
 */
@@ -36,8 +80,16 @@ public:
 	virtual double value(const std::vector<double>& x) const = 0;
 	/// Compute the function gradient at point @p x
 	std::vector<double> gradient(const std::vector<double>& x) const;
-	/// Compute the vector of second derivatives at point @p x
-	std::vector<double> curvature(const std::vector<double>& x) const;
+	/// Compute the function gradient at point @p x in @p result, reusing its storage. By default, use forward finite differences
+	virtual void gradient(const std::vector<double>& x, std::vector<double>& result) const;
+	/**
+	* Indicate whether gradient is cheap and exact, e.g. computed analytically. Line searches then look for a step
+	* satisfying the strong Wolfe conditions, using the gradient along the line. Otherwise, they bracket the line
+	* extremum from function values only, and refine it with Brent's method.
+	*/
+	virtual bool hasGradient() const { return false; }
+	/// Compute the vector of second derivatives at point @p x. By default, use central finite differences
+	virtual std::vector<double> curvature(const std::vector<double>& x) const;
 	/// Search the extremum of the function along a line that crosses point @p x and directed along @p u
 	std::vector<double> lineExtremum(const std::vector<double>& x, const std::vector<double>& u, bool min) const;
 	std::vector<double> lineMinimum(const std::vector<double>& x, const std::vector<double>& u) const { return lineExtremum(x, u, true); }
@@ -46,31 +98,121 @@ public:
 	std::vector<double> localExtremum(const std::vector<double>& x, bool min) const;
 	std::vector<double> localMinimum(const std::vector<double>& x) const { return localExtremum(x, true); }
 	std::vector<double> localMaximum(const std::vector<double>& x) const { return localExtremum(x, false); }
-	/// Search the absolute extremum by random search
+	/**
+	* Search the absolute extremum within the bounds given by setBounds.
+	* Random points are drawn uniformly in the bounds on all the available threads,
+	* and the best candidates are polished with localExtremum. The search stops as soon as
+	* the goal set by setGoal is reached. For a given seed, the result does not depend
+	* on the number of threads.
+	*/
 	std::vector<double> absoluteExtremum(bool min) const;
 	std::vector<double> absoluteMinimum() const { return absoluteExtremum(true); }
 	std::vector<double> absoluteMaximum() const { return absoluteExtremum(false); }
 	/// Indicate whether the above search function succeded or not
 	bool optimizationSuccess() { return m_success; }
+	/// @return the work done by the above search functions since the last call to resetStats
+	const OptimizationStats& stats() const { return m_stats; }
+	void resetStats() { m_stats = OptimizationStats(); }
+
+	/// @return a copy of the function that can be evaluated concurrently with this one, or 0 if the function can't be copied
+	virtual Function* clone() const { return 0; }
+	/// Set the search domain of absoluteExtremum. Coordinates with equal @p lower and @p upper bounds are held fixed
+	void setBounds(const std::vector<double>& lower, const std::vector<double>& upper);
+	/// Stop absoluteExtremum as soon as the function value reaches @p goal
+	void setGoal(double goal) { m_goal = goal; m_hasGoal = true; }
+	/// Seed of the random number generator of absoluteExtremum
+	void setSeed(unsigned int seed) { m_seed = seed; }
+	/// Number of random points drawn by absoluteExtremum
+	void setSampleCount(int sampleCount) { m_sampleCount = sampleCount; }
+	/// Maximum number of threads used by absoluteExtremum. Defaults to Parallel::threadCount()
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+	/// Maximum number of iterations of localExtremum. Defaults to 250
+	void setIterationLimit(int iterationLimit) { m_iterationLimit = iterationLimit; }
+	/**
+	* localExtremum stops, and succeeds, as soon as the function value reaches @p stopValue.
+	* Defaults to the goal set by setGoal, or without goal to 0.99999 for a maximum (an overlap) and to no stop for a minimum
+	*/
+	void setStopValue(double stopValue) { m_stopValue = stopValue; m_hasStopValue = true; }
+	/// Report the progress of the search functions to @p control, and stop them when it is cancelled
+	void setControl(OptimizationControl* control) { m_control = control; }
+	/**
+	* Constrain localExtremum to the points satisfying @p constraint. A constrained search first moves its start point
+	* inside the constraints, and then never evaluates the function outside of them: it follows the conjugate gradient
+	* projected on the active constraints, and releases a constraint when the function improves away from it.
+	*/
+	void addConstraint(const LinearConstraint& constraint) { m_constraints.push_back(constraint); }
+	void clearConstraints() { m_constraints.clear(); }
+	const std::vector<LinearConstraint>& constraints() const { return m_constraints; }
 
 private:
 	// Set search extremum type
 	void setExtremumType(bool min) const { m_min = min; }
 	// Set line search parameters: start point and direction
 	void setLine(const std::vector<double>& point, const std::vector<double>& direction) const;
-	// Parametric representation of a line, given line parameters defined by setLine
-	std::vector<double> lineParametric(double x) const;
+	// Point of parameter @p x of the line defined by setLine, written in m_lineTrial
+	const std::vector<double>& linePoint(double x) const;
 	// Value of the function along along a line this value is signed according to the type of extremum searched
 	double lineValue(double x) const;
-	// Line search algorithms
-	std::vector<double> bracketMinimum(double start, double stop) const;
-	double brent(const std::vector<double>& bracket) const;
-
+	// Derivative of lineValue at @p x, which also stores the gradient at this point in m_lineGradient
+	double lineSlope(double x) const;
+	// Value of the function, counted in the statistics
+	double evaluate(const std::vector<double>& x) const;
+	// Line search algorithms. They return the step along the line, and do not allocate memory once the line buffers are sized
+	double lineSearch(double value0, double slope0, double step) const;
+	double wolfeSearch(double value0, double slope0, double step) const;
+	double wolfeZoom(double value0, double slope0, double lo, double valueLo, double slopeLo, double hi, double valueHi, double slopeHi, bool hiSlopeKnown) const;
+	void bracketMinimum(double& a, double& b, double& c) const;
+	double brent(double a, double b, double x) const;
+	// Communication with the owner of the optimization
+	bool cancelled() const { return m_control && m_control->cancel; }
+	void reportProgress(double progress) const;
+	void reportValue(double value, bool min) const;
+	// Project @p x inside the bounds of absoluteExtremum
+	void project(std::vector<double>& x) const;
+	// Move @p x inside the constraints by successive projections. @return false if it failed
+	bool makeFeasible(std::vector<double>& x) const;
+	// @return the value at which localExtremum stops, which is infinite if it has no stop value
+	double stopValue() const;
+	// @return true if @p value reaches the stop value
+	bool reached(double value) const { return m_min ? (value <= stopValue()) : (value >= stopValue()); }
+	// Project the steepest descent direction @p descent on the active constraints at @p x, which are stored in m_active.
+	// Constraints whose multiplier shows that the function improves away from them are released
+	void projectedDescent(const std::vector<double>& x, std::vector<double>& descent) const;
+	// Remove from @p v its components along the normals of the active constraints
+	void projectOnActive(std::vector<double>& v) const;
+	// Range of steps along @p direction that keep @p x inside the inactive constraints
+	void feasibleSteps(const std::vector<double>& x, const std::vector<double>& direction, double& minStep, double& maxStep) const;
 
 private:
 	mutable bool m_min, m_success;
 	mutable std::vector<double> m_linePoint;
 	mutable std::vector<double> m_lineDirection;
+	// Line search buffers: last point evaluated on the line, and gradient at the point of parameter m_lineGradientStep
+	mutable std::vector<double> m_lineTrial;
+	mutable std::vector<double> m_lineGradient;
+	mutable double m_lineGradientStep;
+	// Range of steps of the line search allowed by the constraints
+	mutable double m_lineMinStep, m_lineMaxStep;
+	// Finite differences buffer
+	mutable std::vector<double> m_gradientPoint;
+	mutable OptimizationStats m_stats;
+	// Absolute extremum search parameters
+	std::vector<double> m_lowerBound, m_upperBound;
+	double m_goal;
+	bool m_hasGoal;
+	unsigned int m_seed;
+	int m_sampleCount;
+	int m_threadCount;
+	OptimizationControl* m_control;
+	// Local search parameters
+	int m_iterationLimit;
+	double m_stopValue;
+	bool m_hasStopValue;
+	// Constraints of localExtremum
+	std::vector<LinearConstraint> m_constraints;
+	// Active set buffers: active constraints, orthonormal basis of their normals and triangular factor
+	mutable std::vector<int> m_active, m_previousActive;
+	mutable std::vector<double> m_activeBasis, m_activeFactor, m_multipliers;
 };
 
 #endif
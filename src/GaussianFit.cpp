@@ -17,21 +17,92 @@
 */
 
 #include "GaussianFit.h"
+#include "Parallel.h"
 #include "Statistics.h"
 #include "lmmin.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <limits>
 
 using namespace std;
 
+namespace
+{
+
+/// A candidate fit whose residue is above abortRatio times the residue of the reference fit after abortEvaluations evaluations is aborted
+const double abortRatio = 2.;
+const int abortEvaluations = 12;
+/// A warm started fit skips the other initial guesses while its mean squared residue stays below warmGrowth times
+/// the one of the last fit in which all the guesses competed
+const double warmGrowth = 1.5;
+/// Minimal number of points times guesses for the non linear fits to run on several threads. A point of a guess costs
+/// about 0.3 µs of non linear fit, and starting the threads of a parallel loop about 60 µs
+const int parallelWork = 1024;
+
+/// Radius at @p z of a beam of waist @p waist at @p waistPosition, where @p theta = M²*wavelength/pi
+inline double beamRadius(double z, double waist, double waistPosition, double theta)
+{
+	return sqrt(sqr(waist) + sqr(theta*(z - waistPosition)/waist));
+}
+
+/// Invert the @p n x @p n matrix @p matrix, stored row by row, by Gauss-Jordan elimination. @return false if it is singular
+bool invert(vector<double>& matrix, int n)
+{
+	vector<double> inverse(n*n, 0.);
+	for (int i = 0; i < n; i++)
+		inverse[i*n + i] = 1.;
+
+	for (int c = 0; c < n; c++)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < n; r++)
+			if (fabs(matrix[r*n + c]) > fabs(matrix[pivot*n + c]))
+				pivot = r;
+		if (matrix[pivot*n + c] == 0.)
+			return false;
+		for (int k = 0; k < n; k++)
+		{
+			swap(matrix[c*n + k], matrix[pivot*n + k]);
+			swap(inverse[c*n + k], inverse[pivot*n + k]);
+		}
+
+		const double factor = 1./matrix[c*n + c];
+		for (int k = 0; k < n; k++)
+		{
+			matrix[c*n + k] *= factor;
+			inverse[c*n + k] *= factor;
+		}
+		for (int r = 0; r < n; r++)
+			if ((r != c) && (matrix[r*n + c] != 0.))
+			{
+				const double f = matrix[r*n + c];
+				for (int k = 0; k < n; k++)
+				{
+					matrix[r*n + k] -= f*matrix[c*n + k];
+					inverse[r*n + k] -= f*inverse[c*n + k];
+				}
+			}
+	}
+
+	matrix.swap(inverse);
+	return true;
+}
+
+}
+
 Fit::Fit(int nData)
 {
 	m_dirty = true;
+	m_gathered = -1;
 	m_lastWavelength = 0.;
 	m_dataType = Radius_e2;
 	m_color = 0;
 	m_orientation = Spherical;
+	m_guesses = DefaultFitGuesses;
+	m_fitM2 = false;
+	m_M2 = 1.;
 
 	for (int i = 0; i < nData; i++)
 		addData(0., 0., Spherical);
@@ -86,6 +157,7 @@ void Fit::setDataType(FitDataType dataType)
 {
 	m_dataType = dataType;
 	m_dirty = true;
+	m_gathered = -1;
 	changed.emit(this);
 }
 
@@ -93,6 +165,22 @@ void Fit::setOrientation(Orientation orientation)
 {
 	m_orientation = orientation;
 	m_dirty = true;
+	m_gathered = -1;
+	changed.emit(this);
+}
+
+void Fit::setGuesses(int guesses)
+{
+	m_guesses = guesses;
+	m_dirty = true;
+	m_gathered = -1;
+	changed.emit(this);
+}
+
+void Fit::setFitM2(bool fitM2)
+{
+	m_fitM2 = fitM2;
+	m_dirty = true;
 	changed.emit(this);
 }
 
@@ -140,16 +228,21 @@ double Fit::value(unsigned int index, Orientation orientation) const
 
 double Fit::radius(unsigned int index, Orientation orientation) const
 {
-	if (m_dataType == Radius_e2)
-		return value(index, orientation);
-	else if (m_dataType == Diameter_e2)
-		return value(index, orientation)/2.;
-	else  if (m_dataType == standardDeviation)
-		return value(index, orientation)*2.;
-	else  if (m_dataType == FWHM)
-		return value(index, orientation)/sqrt(2.*log(2.));
-	else  if (m_dataType == HWHM)
-		return value(index, orientation)*sqrt(2./log(2.));
+	return radius(value(index, orientation), m_dataType);
+}
+
+double Fit::radius(double value, FitDataType dataType)
+{
+	if (dataType == Radius_e2)
+		return value;
+	else if (dataType == Diameter_e2)
+		return value/2.;
+	else  if (dataType == standardDeviation)
+		return value*2.;
+	else  if (dataType == FWHM)
+		return value/sqrt(2.*log(2.));
+	else  if (dataType == HWHM)
+		return value*sqrt(2./log(2.));
 
 	return 0.;
 }
@@ -196,6 +289,9 @@ void Fit::setData(unsigned int index, double position, double value, Orientation
 
 	m_positions[index] = position;
 	m_dirty = true;
+	// Data that are not gathered yet, e.g. appended data, are gathered incrementally by the next fit
+	if (int(index) < m_gathered)
+		m_gathered = -1;
 
 	changed.emit(this);
 }
@@ -205,6 +301,8 @@ void Fit::removeData(unsigned int index)
 	m_positions.erase(m_positions.begin() + index);
 	m_values.erase(m_values.begin() + index);
 	m_dirty = true;
+	if (int(index) < m_gathered)
+		m_gathered = -1;
 
 	changed.emit(this);
 }
@@ -214,6 +312,7 @@ void Fit::clear()
 	m_positions.clear();
 	m_values.clear();
 	m_dirty = true;
+	m_gathered = -1;
 
 	changed.emit(this);
 }
@@ -232,56 +331,268 @@ double Fit::applyFit(Beam& beam) const
 		beam.setWaist(m_beam.waist(Vertical), Vertical);
 		beam.setWaistPosition(m_beam.waistPosition(Vertical), Vertical);
 	}
+	if (m_fitM2)
+		beam.setM2(m_M2);
 	return m_residue;
 }
 
 /////////////////////////////////////////////////
 // Non linear fit functions
 
+void Fit::Workspace::clear()
+{
+	positions.clear();
+	radii.clear();
+	statistics.clear();
+	warmStart = false;
+	fullSize = 0;
+	fullResidue2 = 0.;
+}
+
+void Fit::Workspace::add(double position, double radius)
+{
+	positions.push_back(position);
+	radii.push_back(radius);
+	statistics.add(position, radius);
+}
+
+struct Fit::Candidate
+{
+	const Workspace* workspace;
+	double abortResidue;
+	double bestResidue;
+	int nEvaluations;
+};
+
 /**
 * @p par   input array. At the end of the minimization, it contains the approximate solution vector.
 * @p m_dat positive integer input variable set to the number of functions.
 * @p fvec  is an output array of length m_dat which contains the function values the square sum of which ought to be minimized.
-* @p data  user data. Here null
+* @p data  user data. Here the candidate fit
 * @p info  integer output variable. If set to a negative value, the minimization procedure will stop.
 */
-void Fit::lm_evaluate_beam(const double* par, int /*m_dat*/, const void* data, double* fvec, int* /*info*/)
+void Fit::lm_evaluate_beam(const double* par, int /*m_dat*/, const void* data, double* fvec, int* info)
 {
-	const Fit* fit = static_cast<const Fit*>(data);
+	Candidate* candidate = const_cast<Candidate*>(static_cast<const Candidate*>(data));
+	const Workspace* workspace = candidate->workspace;
 
 	int j = 0;
+	double residue = 0.;
 	/// @todo index = 1., M2 = 1. ?
-	Beam beam(par[0], par[1], fit->m_lastWavelength, 1., 1.);
+	Beam beam(par[0], par[1], workspace->wavelength, 1., 1.);
 
-	for (unsigned int i = 0; i < fit->m_tmpRadii.size(); i++)
-			fvec[j++] = fit->m_tmpRadii[i] - beam.radius(fit->m_tmpPositions[i]);
+	for (unsigned int i = 0; i < workspace->radii.size(); i++)
+	{
+		fvec[j] = workspace->radii[i] - beam.radius(workspace->positions[i]);
+		residue += sqr(fvec[j++]);
+	}
 
-	// if <parameters drifted away> { *info = -1; }
+	// The residue of the best point found so far bounds the final residue: stop if it is still far from the reference
+	candidate->bestResidue = ::min(candidate->bestResidue, sqrt(residue));
+	if ((++candidate->nEvaluations >= abortEvaluations) && (candidate->bestResidue > candidate->abortResidue))
+		*info = -1;
 }
 
-pair<Beam, double> Fit::nonLinearFit(const Beam& guessBeam) const
+pair<Beam, double> Fit::nonLinearFit(const Beam& guessBeam, const Workspace& workspace, double abortResidue)
 {
 	const int nPar = 2;
 	double par[nPar] = {guessBeam.waist(), guessBeam.waistPosition()};
+	Candidate candidate = {&workspace, abortResidue, numeric_limits<double>::infinity(), 0};
 
 	lm_control_struct control = lm_control_double;
 	lm_status_struct status;
-	lmmin(nPar, par, m_tmpRadii.size(), (void*)(this), Fit::lm_evaluate_beam, &control, &status, NULL);
+	lmmin(nPar, par, workspace.radii.size(), &candidate, Fit::lm_evaluate_beam, &control, &status, NULL);
 
-	pair<Beam, double> result(guessBeam, status.fnorm);
+	pair<Beam, double> result(guessBeam, status.info == 11 ? numeric_limits<double>::infinity() : status.fnorm);
 	result.first.setWaist(par[0]);
 	result.first.setWaistPosition(par[1]);
 
 	return result;
 }
 
+/// Parameters of lm_evaluate_joint
+struct Fit::JointFitData
+{
+	const vector<Workspace*>* workspaces;
+	bool fitM2;
+};
+
+void Fit::lm_evaluate_joint(const double* par, int /*m_dat*/, const void* data, double* fvec, int* /*info*/)
+{
+	const JointFitData* joint = static_cast<const JointFitData*>(data);
+	const vector<Workspace*>& workspaces = *joint->workspaces;
+	const double M2 = joint->fitM2 ? par[2*workspaces.size()] : 1.;
+
+	int j = 0;
+	for (unsigned int w = 0; w < workspaces.size(); w++)
+	{
+		const double theta = M2*workspaces[w]->wavelength/M_PI;
+		for (unsigned int i = 0; i < workspaces[w]->radii.size(); i++)
+			fvec[j++] = workspaces[w]->radii[i] - beamRadius(workspaces[w]->positions[i], par[2*w], par[2*w + 1], theta);
+	}
+}
+
+bool Fit::hyperbolicFit(const Workspace& workspace, double* parameters)
+{
+	// Least squares fit of the squared radius by a parabola in t = z - mean(z): w² = A t² + B t + C
+	const double mean = workspace.statistics.meanX;
+	vector<double> normal(9, 0.);
+	double b[3] = {0., 0., 0.};
+	for (unsigned int i = 0; i < workspace.positions.size(); i++)
+	{
+		const double t = workspace.positions[i] - mean;
+		const double basis[3] = {sqr(t), t, 1.};
+		for (int k = 0; k < 3; k++)
+		{
+			b[k] += basis[k]*sqr(workspace.radii[i]);
+			for (int l = 0; l < 3; l++)
+				normal[3*k + l] += basis[k]*basis[l];
+		}
+	}
+	if (!invert(normal, 3))
+		return false;
+
+	double abc[3] = {0., 0., 0.};
+	for (int k = 0; k < 3; k++)
+		for (int l = 0; l < 3; l++)
+			abc[k] += normal[3*k + l]*b[l];
+
+	// w² = w0² + theta²(z - zw)²/w0²
+	const double waist2 = abc[2] - sqr(abc[1])/(4.*abc[0]);
+	if ((abc[0] <= 0.) || (waist2 <= 0.))
+		return false;
+
+	parameters[0] = sqrt(waist2);
+	parameters[1] = mean - abc[1]/(2.*abc[0]);
+	parameters[2] = M_PI*parameters[0]*sqrt(abc[0])/workspace.wavelength;
+	return true;
+}
+
+void Fit::jointFit(const vector<Workspace*>& workspaces, bool fitM2, vector<double>& parameters,
+                   vector<double>& residues, vector<double>& covariance)
+{
+	const int nWorkspaces = workspaces.size();
+	int nPoints = 0;
+	for (int w = 0; w < nWorkspaces; w++)
+		nPoints += workspaces[w]->positions.size();
+	fitM2 = fitM2 && (nWorkspaces > 0) && (nPoints >= 2*nWorkspaces + 1);
+	const int nPar = 2*nWorkspaces + (fitM2 ? 1 : 0);
+
+	residues.resize(nWorkspaces);
+	for (int w = 0; w < nWorkspaces; w++)
+		residues[w] = workspaces[w]->result.second;
+
+	if (!fitM2)
+	{
+		parameters.resize(nPar);
+		for (int w = 0; w < nWorkspaces; w++)
+		{
+			parameters[2*w] = workspaces[w]->result.first.waist();
+			parameters[2*w + 1] = workspaces[w]->result.first.waistPosition();
+		}
+	}
+	else
+	{
+		// Starting points: the previous parameters, if any, the fit with M² = 1 and the hyperbolic fit
+		vector<vector<double> > guesses;
+		if (int(parameters.size()) == nPar)
+			guesses.push_back(parameters);
+
+		vector<double> guess(nPar, 1.);
+		for (int w = 0; w < nWorkspaces; w++)
+		{
+			guess[2*w] = workspaces[w]->result.first.waist();
+			guess[2*w + 1] = workspaces[w]->result.first.waistPosition();
+		}
+		guesses.push_back(guess);
+
+		bool hyperbolic = true;
+		double M2 = 1.;
+		for (int w = 0; w < nWorkspaces; w++)
+		{
+			double fit[3];
+			if (!hyperbolicFit(*workspaces[w], fit))
+			{
+				hyperbolic = false;
+				break;
+			}
+			guess[2*w] = fit[0];
+			guess[2*w + 1] = fit[1];
+			M2 *= fit[2];
+		}
+		if (hyperbolic)
+		{
+			guess[nPar - 1] = pow(M2, 1./nWorkspaces);
+			guesses.push_back(guess);
+		}
+
+		JointFitData data = {&workspaces, true};
+		lm_control_struct control = lm_control_double;
+		lm_status_struct status;
+		double bestResidue = numeric_limits<double>::infinity();
+		for (vector<vector<double> >::iterator guess = guesses.begin(); guess != guesses.end(); guess++)
+		{
+			lmmin(nPar, &(*guess)[0], nPoints, &data, Fit::lm_evaluate_joint, &control, &status, NULL);
+			if ((guess == guesses.begin()) || (status.fnorm < bestResidue))
+			{
+				bestResidue = status.fnorm;
+				parameters = *guess;
+			}
+		}
+
+		// The radius only depends on the squares of the waist and of M²
+		for (int w = 0; w < nWorkspaces; w++)
+			parameters[2*w] = fabs(parameters[2*w]);
+		parameters[nPar - 1] = fabs(parameters[nPar - 1]);
+	}
+
+	// Covariance s²(J^T J)^-1, where J is the Jacobian of the radii with respect to the parameters
+	// and s² = |residuals|²/(points - parameters)
+	covariance.clear();
+	if (nPoints <= nPar)
+		return;
+
+	const double M2 = fitM2 ? parameters[nPar - 1] : 1.;
+	vector<double> normal(nPar*nPar, 0.);
+	vector<double> jacobian(nPar);
+	double residue2 = 0.;
+	for (int w = 0; w < nWorkspaces; w++)
+	{
+		const Workspace& workspace = *workspaces[w];
+		const double waist = parameters[2*w];
+		const double theta = M2*workspace.wavelength/M_PI;
+		double workspaceResidue2 = 0.;
+		for (unsigned int i = 0; i < workspace.positions.size(); i++)
+		{
+			const double dz = workspace.positions[i] - parameters[2*w + 1];
+			const double radius = beamRadius(workspace.positions[i], waist, parameters[2*w + 1], theta);
+			fill(jacobian.begin(), jacobian.end(), 0.);
+			jacobian[2*w] = (waist - sqr(theta*dz)/(waist*sqr(waist)))/radius;
+			jacobian[2*w + 1] = -sqr(theta/waist)*dz/radius;
+			if (fitM2)
+				jacobian[nPar - 1] = sqr(theta*dz/waist)/(radius*M2);
+			for (int k = 0; k < nPar; k++)
+				for (int l = 0; l < nPar; l++)
+					normal[k*nPar + l] += jacobian[k]*jacobian[l];
+			workspaceResidue2 += sqr(workspace.radii[i] - radius);
+		}
+		residue2 += workspaceResidue2;
+		if (fitM2)
+			residues[w] = sqrt(workspaceResidue2);
+	}
+
+	if (!invert(normal, nPar))
+		return;
+	covariance = normal;
+	for (vector<double>::iterator it = covariance.begin(); it != covariance.end(); it++)
+		*it *= residue2/(nPoints - nPar);
+}
+
 /////////////////////////////////////////////////
 // Linear fit functions
 
-Beam Fit::linearFit(const vector<double>& positions, const vector<double>& radii, double wavelength) const
+Beam Fit::linearFit(const Statistics& stats, double wavelength)
 {
-	Statistics stats(positions, radii);
-
 	// Some point whithin the fit
 	const double z = stats.meanX;
 	// beam radius at z
@@ -305,71 +616,296 @@ void Fit::fitBeam(double wavelength) const
 	if (!m_dirty && (wavelength == m_lastWavelength))
 		return;
 
-	m_lastWavelength = wavelength;
-
+	// The two orientations of an ellipsoidal fit are fitted together
+	vector<Orientation> orientations;
 	if (m_orientation != Ellipsoidal)
-		m_residue = fitBeam(wavelength, m_orientation);
+		orientations.push_back(m_orientation);
 	else
 	{
-		double r1 = fitBeam(wavelength, Horizontal);
-		double r2 = fitBeam(wavelength, Vertical);
-		m_residue = sqrt(r1*r2);
+		orientations.push_back(Horizontal);
+		orientations.push_back(Vertical);
+	}
+
+	// Gather the non zero data. If the data gathered for the previous fit are still valid, only add the new entries,
+	// and start the non linear fit from the previous result
+	const bool sameWavelength = (wavelength == m_lastWavelength);
+	if (m_gathered < 0)
+	{
+		m_workspaces[0].clear();
+		m_workspaces[1].clear();
+		m_gathered = 0;
+	}
+
+	vector<Workspace*> workspaces;
+	for (unsigned int o = 0; o < orientations.size(); o++)
+	{
+		Workspace& workspace = m_workspaces[o];
+		workspace.warmStart = sameWavelength && (workspace.positions.size() >= 2);
+		workspace.wavelength = wavelength;
+		for (int i = m_gathered; i < size(); i++)
+		{
+			const double r = radius(i, orientations[o]);
+			if (r > Utils::epsilon)
+				workspace.add(position(i), r);
+		}
+		if (workspace.positions.size() >= 2)
+			workspaces.push_back(&workspace);
 	}
+	m_gathered = size();
+	m_lastWavelength = wavelength;
+
+	fitWorkspaces(workspaces, m_guesses, 0);
+
+	// The M² fit also starts from its previous solution if all the orientations are warm started
+	bool warmStart = true;
+	for (vector<Workspace*>::const_iterator workspace = workspaces.begin(); workspace != workspaces.end(); workspace++)
+		warmStart = warmStart && (*workspace)->warmStart;
+	if (!warmStart)
+		m_parameters.clear();
+	vector<double> residues;
+	jointFit(workspaces, m_fitM2, m_parameters, residues, m_covariance);
+	m_M2 = (int(m_parameters.size()) > 2*int(workspaces.size())) ? m_parameters.back() : 1.;
+
+	// Orientations without enough data have a residue of 1
+	m_residue = 1.;
+	for (unsigned int o = 0, w = 0; o < orientations.size(); o++)
+		if (m_workspaces[o].positions.size() >= 2)
+		{
+			m_beam.setWaist(m_parameters[2*w], orientations[o]);
+			m_beam.setWaistPosition(m_parameters[2*w + 1], orientations[o]);
+			m_residue *= residues[w++];
+		}
+	if (orientations.size() == 2)
+		m_residue = sqrt(m_residue);
 
 	m_dirty = false;
 }
 
-double Fit::fitBeam(double wavelength, Orientation orientation) const
+void Fit::makeGuesses(Workspace& workspace, int guesses)
 {
-	if (nonZeroSize(orientation) < 2)
-		return 1.;
+	const vector<double>& positions = workspace.positions;
+	const vector<double>& radii = workspace.radii;
+	const int n = positions.size();
+	workspace.guesses.clear();
+
+	// Warm start: the previous result is close to the new one when points are appended one at a time, and is the reference
+	// candidate, against which the other candidates are quickly aborted, see fitWorkspaces
+	if (workspace.warmStart)
+		workspace.guesses.push_back(workspace.result.first);
+
+	if ((guesses & AllPointsGuess) || !(guesses & (FirstPointsGuess | LastPointsGuess | PairGuesses | MinimumRadiusGuess)))
+		workspace.guesses.push_back(linearFit(workspace.statistics, workspace.wavelength));
+
+	// Pairs of points, the first two and the last two being the first and last pairs
+	vector<int> pairs;
+	if (guesses & FirstPointsGuess)
+		pairs.push_back(0);
+	if (guesses & LastPointsGuess)
+		pairs.push_back(n - 2);
+	if (guesses & PairGuesses)
+		for (int i = 0; i < n - 1; i++)
+			if (!((i == 0) && (guesses & FirstPointsGuess)) && !((i == n - 2) && (guesses & LastPointsGuess)))
+				pairs.push_back(i);
+	for (vector<int>::const_iterator first = pairs.begin(); first != pairs.end(); first++)
+	{
+		Statistics pairStatistics;
+		pairStatistics.add(positions[*first], radii[*first]);
+		pairStatistics.add(positions[*first + 1], radii[*first + 1]);
+		workspace.guesses.push_back(linearFit(pairStatistics, workspace.wavelength));
+	}
 
-	// Gather all non zero data
-	m_tmpPositions.clear();
-	m_tmpRadii.clear();
-	for (int i = 0; i < size(); i++)
-		if (radius(i, orientation) > Utils::epsilon)
+	if (guesses & MinimumRadiusGuess)
+	{
+		const int i = min_element(radii.begin(), radii.end()) - radii.begin();
+		workspace.guesses.push_back(Beam(radii[i], positions[i], workspace.wavelength, 1., 1.));
+	}
+}
+
+void Fit::fitWorkspaces(const vector<Workspace*>& workspaces, int guesses, int nThreads)
+{
+	int work = 0;
+	for (unsigned int w = 0; w < workspaces.size(); w++)
+	{
+		makeGuesses(*workspaces[w], guesses);
+		workspaces[w]->candidates.resize(workspaces[w]->guesses.size());
+		work += workspaces[w]->guesses.size()*workspaces[w]->positions.size();
+	}
+
+	// Threads do not pay off for small fits
+	if (work < parallelWork)
+		nThreads = 1;
+	else if (nThreads <= 0)
+		nThreads = Parallel::threadCount();
+
+	// The reference candidates are solved first. The other candidates are aborted if they cannot compete with them,
+	// hence the result does not depend on the number of threads
+	auto reference = [&](int w, int /*thread*/)
+	{
+		Workspace& workspace = *workspaces[w];
+		workspace.candidates[0] = nonLinearFit(workspace.guesses[0], workspace, numeric_limits<double>::infinity());
+	};
+	Parallel::forEach(workspaces.size(), reference, nThreads);
+
+	// Candidates, as (workspace, guess) pairs, other than the reference candidates. A warm started fit whose residue
+	// did not grow stays in the basin of the previous result. The new points may however have moved the minimum to
+	// another basin: all the guesses compete again when the residue grows, and at the latest when the number of points
+	// doubles. The latter full fits of a scan of n points then cost about as much as two full fits of n points
+	vector<pair<int, int> > candidates;
+	vector<bool> full(workspaces.size(), false);
+	for (unsigned int w = 0; w < workspaces.size(); w++)
+	{
+		Workspace& workspace = *workspaces[w];
+		const int n = workspace.positions.size();
+		if (workspace.warmStart && (n < 2*workspace.fullSize) &&
+		    (sqr(workspace.candidates[0].second) <= warmGrowth*workspace.fullResidue2*n))
 		{
-			m_tmpPositions.push_back(position(i));
-			m_tmpRadii.push_back(radius(i, orientation));
+			workspace.candidates.resize(1);
+			continue;
 		}
+		full[w] = true;
+		for (unsigned int g = 1; g < workspace.guesses.size(); g++)
+			candidates.push_back(make_pair(w, g));
+	}
 
-	pair<Beam, double> result, tmpResult;
+	auto solve = [&](int c, int /*thread*/)
+	{
+		Workspace& workspace = *workspaces[candidates[c].first];
+		const int g = candidates[c].second;
+		workspace.candidates[g] = nonLinearFit(workspace.guesses[g], workspace, abortRatio*workspace.candidates[0].second);
+	};
+	Parallel::forEach(candidates.size(), solve, nThreads);
+
+	// Lowest residue, the first candidate on ties
+	for (unsigned int w = 0; w < workspaces.size(); w++)
+	{
+		Workspace& workspace = *workspaces[w];
+		workspace.result = workspace.candidates[0];
+		for (unsigned int g = 1; g < workspace.candidates.size(); g++)
+			if (workspace.candidates[g].second < workspace.result.second)
+				workspace.result = workspace.candidates[g];
+		if (full[w])
+		{
+			workspace.fullSize = workspace.positions.size();
+			workspace.fullResidue2 = sqr(workspace.result.second)/workspace.fullSize;
+		}
+	}
+}
 
-	// 1/ linear fit with all data
-	result.first = linearFit(m_tmpPositions, m_tmpRadii, wavelength);
-	// 2/ non linear fit with the linear fit result as initial guess
-	result = nonLinearFit(result.first);
-	// 3/ Try a linear fit with the first two points + non linear fit on all points
-	vector<double> positions, radii;
-	for (int i = 0; (i < size()) && (positions.size() < 2); i++)
-		if (radius(i, orientation) > Utils::epsilon)
+vector<FitResult> Fit::fitDatasets(const vector<FitDataset>& datasets, int nThreads, int guesses)
+{
+	if (nThreads <= 0)
+		nThreads = Parallel::threadCount();
+
+	// One workspace per thread, whose buffers are reused from one dataset to the next.
+	// The guesses of a dataset are solved on the thread of the dataset
+	vector<FitResult> results(datasets.size());
+	vector<Workspace> workspaces(::max(1, ::min(nThreads, int(datasets.size()))));
+	auto fit = [&](int index, int thread)
+	{
+		const FitDataset& dataset = datasets[index];
+		Workspace& workspace = workspaces[thread];
+		workspace.clear();
+		workspace.wavelength = dataset.wavelength;
+		for (unsigned int i = 0; (i < dataset.values.size()) && (i < dataset.positions.size()); i++)
 		{
-			positions.push_back(position(i));
-			radii.push_back(radius(i, orientation));
+			const double radius = Fit::radius(dataset.values[i], dataset.dataType);
+			if (radius > Utils::epsilon)
+				workspace.add(dataset.positions[i], radius);
 		}
-	tmpResult.first = linearFit(positions, radii, wavelength);
-	tmpResult = nonLinearFit(tmpResult.first);
-	if (tmpResult.second < result.second)
-		result = tmpResult;
-	// 4/ Try a linear fit with the last two points + non linear fit on all points
-	positions.clear();
-	radii.clear();
-	for (int i = size()-1; (i >= 0) && (positions.size() < 2); i--)
-		if (radius(i, orientation) > Utils::epsilon)
+
+		FitResult& result = results[index];
+		result.success = workspace.radii.size() >= 2;
+		result.waist = result.waistPosition = 0.;
+		result.M2 = 1.;
+		result.residue = 1.;
+		result.covariance.clear();
+		if (!result.success)
+			return;
+
+		const vector<Workspace*> fitted(1, &workspace);
+		fitWorkspaces(fitted, guesses, 1);
+		vector<double> parameters, residues;
+		jointFit(fitted, dataset.fitM2, parameters, residues, result.covariance);
+		result.waist = parameters[0];
+		result.waistPosition = parameters[1];
+		result.M2 = (parameters.size() > 2) ? parameters[2] : 1.;
+		result.residue = residues[0];
+	};
+	Parallel::forEach(datasets.size(), fit, nThreads);
+
+	return results;
+}
+
+bool Fit::fitResample(const Fit& fit, double wavelength, const vector<int>& entries, vector<double>& parameters, ResampleBuffers& buffers)
+{
+	parameters.clear();
+	if (fit.m_dirty || (wavelength != fit.m_lastWavelength))
+		return false;
+
+	buffers.fitted.clear();
+	for (int o = 0; o < 2; o++)
+	{
+		const Workspace& reference = fit.m_workspaces[o];
+		if (reference.positions.size() < 2)
+			continue;
+
+		const Orientation orientation = (fit.m_orientation != Ellipsoidal) ? fit.m_orientation : (o ? Vertical : Horizontal);
+		Workspace& workspace = buffers.workspaces[buffers.fitted.size()];
+		workspace.clear();
+		workspace.wavelength = wavelength;
+		for (vector<int>::const_iterator entry = entries.begin(); entry != entries.end(); entry++)
 		{
-			positions.push_back(position(i));
-			radii.push_back(radius(i, orientation));
+			if ((*entry < 0) || (*entry >= fit.size()))
+				return false;
+			const double r = fit.radius(*entry, orientation);
+			if (r > Utils::epsilon)
+				workspace.add(fit.position(*entry), r);
 		}
-	tmpResult.first = linearFit(positions, radii, wavelength);
-	tmpResult = nonLinearFit(tmpResult.first);
-	if (tmpResult.second < result.second)
-		result = tmpResult;
+		if ((workspace.positions.size() < 2) ||
+		    (*min_element(workspace.positions.begin(), workspace.positions.end()) ==
+		     *max_element(workspace.positions.begin(), workspace.positions.end())))
+			return false;
 
-	m_beam.setWaist(result.first.waist(), orientation);
-	m_beam.setWaistPosition(result.first.waistPosition(), orientation);
+		workspace.warmStart = true;
+		workspace.result = reference.result;
+		buffers.fitted.push_back(&workspace);
+	}
+	if (buffers.fitted.empty())
+		return false;
+
+	// The other guesses are left out: the pairs of points of a resample are random draws
+	fitWorkspaces(buffers.fitted, AllPointsGuess, 1);
+	const bool fitM2 = fit.m_parameters.size() > 2*buffers.fitted.size();
+	if (fitM2)
+		parameters = fit.m_parameters;
+	jointFit(buffers.fitted, fitM2, parameters, buffers.residues, buffers.covariance);
+
+	bool finite = parameters.size() == fit.m_parameters.size();
+	for (vector<double>::const_iterator it = parameters.begin(); it != parameters.end(); it++)
+		finite = finite && (fabs(*it) < numeric_limits<double>::infinity());
+	if (!finite)
+		parameters.clear();
+
+	return finite;
+}
+
+bool Fit::copyResult(const Fit& fit)
+{
+	if (fit.m_dirty || !(*this == fit))
+		return false;
 
-	return result.second;
+	m_beam = fit.m_beam;
+	m_lastWavelength = fit.m_lastWavelength;
+	m_residue = fit.m_residue;
+	m_dirty = false;
+	for (int o = 0; o < 2; o++)
+		m_workspaces[o] = fit.m_workspaces[o];
+	m_gathered = fit.m_gathered;
+	m_M2 = fit.m_M2;
+	m_parameters = fit.m_parameters;
+	m_covariance = fit.m_covariance;
+
+	return true;
 }
 
 bool Fit::operator==(const Fit& other) const
@@ -379,5 +915,7 @@ bool Fit::operator==(const Fit& other) const
 	       (m_positions   == other.m_positions  ) &&
 	       (m_values      == other.m_values     ) &&
 	       (m_color       == other.m_color      ) &&
-	       (m_orientation == other.m_orientation);
+	       (m_orientation == other.m_orientation) &&
+	       (m_guesses     == other.m_guesses    ) &&
+	       (m_fitM2       == other.m_fitM2      );
 }
@@ -20,6 +20,7 @@
 #define GAUSSIANFIT_H
 
 #include "GaussianBeam.h"
+#include "Statistics.h"
 
 #include <vector>
 
@@ -28,6 +29,52 @@
 */
 enum FitDataType {Radius_e2 = 0, Diameter_e2, standardDeviation, FWHM, HWHM};
 
+/**
+* Initial guesses of the non linear fit, combined as flags. Each guess is refined by a non linear fit on all points,
+* and the lowest residue wins.
+* - AllPointsGuess: linear fit of all points
+* - FirstPointsGuess, LastPointsGuess: linear fit of the first, or of the last, two points
+* - PairGuesses: linear fit of each pair of consecutive points
+* - MinimumRadiusGuess: waist at the point of smallest radius
+*/
+enum FitGuess {AllPointsGuess = 1, FirstPointsGuess = 2, LastPointsGuess = 4, PairGuesses = 8, MinimumRadiusGuess = 16,
+               DefaultFitGuesses = AllPointsGuess | FirstPointsGuess | LastPointsGuess};
+
+/**
+* Beam size measurements on a single orientation, fitted by Fit::fitDatasets
+*/
+struct FitDataset
+{
+	FitDataset() : dataType(Radius_e2), wavelength(0.), fitM2(false) {}
+
+	/// Measurement positions
+	std::vector<double> positions;
+	/// Measured values at each position. Values that are zero are ignored
+	std::vector<double> values;
+	/// Type of the measured values
+	FitDataType dataType;
+	/// Wavelength of the beam
+	double wavelength;
+	/// Fit M² as a free parameter, see Fit::setFitM2
+	bool fitM2;
+};
+
+/**
+* Result of the fit of a FitDataset
+*/
+struct FitResult
+{
+	/// false if the dataset has less than two non zero values
+	bool success;
+	double waist;
+	double waistPosition;
+	double M2;
+	/// Norm of the radius residuals
+	double residue;
+	/// Covariance of the waist, waist position and, if fitted, M², see Fit::covariance
+	std::vector<double> covariance;
+};
+
 /**
 * @class Fit
 * Find the waist radius and position for a given set of radii measurement of a Gaussian beam
@@ -35,6 +82,12 @@ enum FitDataType {Radius_e2 = 0, Diameter_e2, standardDeviation, FWHM, HWHM};
 * that is tangent to the resulting line.
 * The fit orientation determines if the data are identical on both axis (Spherical),
 * taken on one particular axis (Horizontal or Vertical) or independantly on both axis (Ellispoidal)
+*
+* The fit keeps the data gathered for its last result. If data are only appended since then, e.g. by addData
+* during a scan, the new points are added to the gathered data and to their running statistics in constant time,
+* and the non linear fit starts from the previous result. The other initial guesses are only tried when the residue
+* grows, or when the number of points has doubled since they were last tried. The result may hence depend on the order
+* in which the points were added, when the data have several local minima.
 */
 class Fit
 {
@@ -59,6 +112,22 @@ public:
 	Orientation orientation() const { return m_orientation; }
 	/// Set the orientation of the fit
 	void setOrientation(Orientation orientation);
+	/// @return the initial guesses of the non linear fit, as a combination of FitGuess flags
+	int guesses() const { return m_guesses; }
+	/**
+	* Set the initial guesses of the non linear fit. Defaults to DefaultFitGuesses.
+	* The guesses are solved on several threads only if the number of points times the number of guesses
+	* exceeds about a thousand: smaller fits take less time than starting the threads, and run on the calling thread
+	*/
+	void setGuesses(int guesses);
+	/// @return true if M² is a free parameter of the fit
+	bool fitM2() const { return m_fitM2; }
+	/**
+	* Fit M² as a free parameter, in addition to the waist and waist position. Defaults to false, with M² = 1.
+	* M² is shared by both orientations: an ellipsoidal fit is a single joint fit of the horizontal and vertical
+	* waists and waist positions, and of M². It needs at least as many points as parameters
+	*/
+	void setFitM2(bool fitM2);
 	/// @return the RGB color associated to the fit
 	unsigned int color() const { return m_color; }
 	/// Set the RGB color accociated to the fit
@@ -69,6 +138,8 @@ public:
 	double value(unsigned int index, Orientation orientation) const;
 	/// @return the measured beam radius at 1/e² computed from the measured data
 	double radius(unsigned int index, Orientation orientation) const;
+	/// @return the measured beam radius at 1/e² corresponding to @p value of type @p dataType
+	static double radius(double value, FitDataType dataType);
 	/// Add a data point @p value , measured at position @p position to the fit
 	void addData(double position, double value, Orientation orientation);
 	/// Set data point number @p index to @p value at position @p position
@@ -87,6 +158,42 @@ public:
 	* @note the given bema wavelength chosen as the fit wavelength
 	*/
 	double applyFit(Beam& beam) const;
+	/// @return the M² of the last fit result: the fitted M², or 1 if M² is not fitted
+	double M2() const { return m_M2; }
+	/**
+	* @return the covariance matrix of the parameters of the last fit result, row by row. The parameters are the waist
+	* and the waist position of each fitted orientation, horizontal first, followed by M² if it is fitted.
+	* The covariance is estimated from the Jacobian of the residuals at the solution, and is empty if the fit
+	* has no more points than parameters
+	*/
+	const std::vector<double>& covariance() const { return m_covariance; }
+	/// @return the parameters of the last fit result, in the order of covariance()
+	const std::vector<double>& parameters() const { return m_parameters; }
+	/**
+	* Take over the fit result computed by @p fit, a copy of this fit, e.g. on another thread
+	* @return false if the data of @p fit differ from the data of this fit, or if it has no result
+	*/
+	bool copyResult(const Fit& fit);
+	/**
+	* Fit each dataset of @p datasets, on up to @p nThreads threads (all cores if @p nThreads is not positive).
+	* Datasets are fitted independently, with the same algorithm as applyFit and the initial guesses @p guesses,
+	* and the result of each dataset does not depend on the number of threads. The M² of the model beam is fitted
+	* if FitDataset::fitM2 is set, and is 1 otherwise.
+	* @return the result of each dataset, in the order of @p datasets
+	*/
+	static std::vector<FitResult> fitDatasets(const std::vector<FitDataset>& datasets, int nThreads = 0, int guesses = DefaultFitGuesses);
+	/// Buffers of fitResample, reused from one call to the next. Concurrent calls need their own buffers
+	struct ResampleBuffers;
+	/**
+	* Fit a resample of the data of @p fit, e.g. for FitBootstrap: the entries @p entries of @p fit, which may repeat.
+	* The fit of all the data, which applyFit must have computed at wavelength @p wavelength, is the reference candidate
+	* of the non linear fits, and the linear fit of the resample competes with it. The M² fit starts from the parameters
+	* of @p fit. @p fit is not modified, so that concurrent calls can share it.
+	* @return false if an orientation fitted by @p fit has less than two distinct positions in the resample, or if the fit
+	* fails. Otherwise, @p parameters is the result, in the order of parameters()
+	*/
+	static bool fitResample(const Fit& fit, double wavelength, const std::vector<int>& entries,
+	                        std::vector<double>& parameters, ResampleBuffers& buffers);
 
 // Signals
 public:
@@ -97,12 +204,57 @@ private:
 	int nonZeroSize(Orientation orientation) const;
 	/// Actually o the fit
 	void fitBeam(double wavelength) const;
-	double fitBeam(double wavelength, Orientation orientation) const;
+	/// Scratch data of a fit. Fits using different workspaces can run concurrently
+	struct Workspace
+	{
+		double wavelength;
+		/// Non zero data, in the order of the fit data, and their statistics
+		std::vector<double> positions;
+		std::vector<double> radii;
+		Statistics statistics;
+		/// Add the previous result to the initial guesses, as the reference candidate
+		bool warmStart;
+		/// Number of points and mean squared residue of the last fit in which all the initial guesses competed
+		int fullSize;
+		double fullResidue2;
+		/// Initial guesses. The first one is the reference candidate
+		std::vector<Beam> guesses;
+		/// Fitted beam and residue for each guess
+		std::vector<std::pair<Beam, double> > candidates;
+		/// Best candidate
+		std::pair<Beam, double> result;
+
+		/// Remove all data
+		void clear();
+		/// Add data point (@p position, @p radius)
+		void add(double position, double radius);
+	};
+	/**
+	* Fit the data gathered in each workspace of @p workspaces, with initial guesses @p guesses,
+	* solving the non linear fits of all guesses on up to @p nThreads threads (all cores if @p nThreads is not positive)
+	*/
+	static void fitWorkspaces(const std::vector<Workspace*>& workspaces, int guesses, int nThreads);
+	static void makeGuesses(Workspace& workspace, int guesses);
 	/// Non linear fit functions
-	std::pair<Beam,double> nonLinearFit(const Beam& guessBeam) const;
+	struct Candidate;
+	/// @return the beam fitted from @p guessBeam and its residue. The fit is aborted, with an infinite residue, if it cannot reach @p abortResidue
+	static std::pair<Beam,double> nonLinearFit(const Beam& guessBeam, const Workspace& workspace, double abortResidue);
 	static void lm_evaluate_beam(const double* par, int m_dat, const void* data, double* fvec, int* info);
+	struct JointFitData;
+	/**
+	* Fit the waist and waist position of each workspace of @p workspaces, starting from their result, together with M² if @p fitM2.
+	* Without @p fitM2, the parameters are the workspace results.
+	* @p parameters is the solution: the waist and waist position of each workspace, followed by M² if it is fitted.
+	* If @p parameters has this size on input, it is also a starting point of the fit, which wins ties.
+	* @p residues is the residue of each workspace, and @p covariance the parameter covariance
+	*/
+	static void jointFit(const std::vector<Workspace*>& workspaces, bool fitM2, std::vector<double>& parameters,
+	                     std::vector<double>& residues, std::vector<double>& covariance);
+	static void lm_evaluate_joint(const double* par, int m_dat, const void* data, double* fvec, int* info);
+	/// @return the hyperbolic fit of the data of @p workspace in @p parameters (waist, waist position, M²), or false if it failed
+	static bool hyperbolicFit(const Workspace& workspace, double* parameters);
 	/// Linear fit functions
-	Beam linearFit(const std::vector<double>& positions, const std::vector<double>& radii, double wavelength) const;
+	static Beam linearFit(const Statistics& statistics, double wavelength);
 
 
 private:
@@ -114,14 +266,28 @@ private:
 	unsigned int m_color;
 	Orientation m_orientation;
 
+	// Settings
+	int m_guesses;
+	bool m_fitM2;
+
 	// Mutables
 	mutable bool m_dirty;
 	mutable Beam m_beam;
 	mutable double m_lastWavelength;
 	mutable double m_residue;
-	mutable std::vector<double> m_tmpPositions;
-	mutable std::vector<double> m_tmpRadii;
+	mutable double m_M2;
+	mutable std::vector<double> m_parameters;
+	mutable std::vector<double> m_covariance;
+	/// Data gathered for each fitted orientation, and number of fit entries they include (-1 if they have to be gathered again)
+	mutable Workspace m_workspaces[2];
+	mutable int m_gathered;
 };
 
+struct Fit::ResampleBuffers
+{
+	Workspace workspaces[2];
+	std::vector<Workspace*> fitted;
+	std::vector<double> residues, covariance;
+};
 
 #endif
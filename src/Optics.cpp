@@ -451,6 +451,95 @@ GenericABCD operator*(const ABCD& abcd1, const ABCD& abcd2)
 	return r;
 }
 
+/////////////////////////////////////////////////
+// OpticsParameter namespace
+
+bool OpticsParameter::get(const Optics* optics, Type type, double& value)
+{
+	const OpticsType opticsType = optics->type();
+
+	if (type == Position)
+		value = optics->position();
+	else if ((type == Width) && ((opticsType == DielectricSlabType) || (opticsType == GenericABCDType)))
+		value = optics->width();
+	else if ((type == Angle) && optics->isRotable())
+		value = optics->angle();
+	else if ((type == Focal) && (opticsType == LensType))
+		value = dynamic_cast<const Lens*>(optics)->focal();
+	else if ((type == CurvatureRadius) && (opticsType == CurvedMirrorType))
+		value = dynamic_cast<const CurvedMirror*>(optics)->curvatureRadius();
+	else if ((type == CurvatureRadius) && (opticsType == CurvedInterfaceType))
+		value = dynamic_cast<const CurvedInterface*>(optics)->surfaceRadius();
+	else if ((type == IndexRatio) && dynamic_cast<const Dielectric*>(optics))
+		value = dynamic_cast<const Dielectric*>(optics)->indexRatio();
+	else if (((type == A) || (type == B) || (type == C) || (type == D)) && (opticsType == GenericABCDType))
+	{
+		const GenericABCD* abcd = dynamic_cast<const GenericABCD*>(optics);
+		value = (type == A) ? abcd->A(Horizontal) : (type == B) ? abcd->B(Horizontal) :
+		        (type == C) ? abcd->C(Horizontal) : abcd->D(Horizontal);
+	}
+	else if ((type == Waist) && (opticsType == CreateBeamType))
+		value = dynamic_cast<const CreateBeam*>(optics)->beam()->waist(Horizontal);
+	else if ((type == WaistPosition) && (opticsType == CreateBeamType))
+		value = dynamic_cast<const CreateBeam*>(optics)->beam()->waistPosition(Horizontal);
+	else
+		return false;
+
+	return true;
+}
+
+bool OpticsParameter::set(Optics* optics, Type type, double value)
+{
+	double oldValue;
+	if (!get(optics, type, oldValue))
+		return false;
+
+	if (type == Position)
+		optics->setPosition(value, true);
+	else if (type == Width)
+		optics->setWidth(value);
+	else if (type == Angle)
+		optics->setAngle(value);
+	else if (type == Focal)
+		dynamic_cast<Lens*>(optics)->setFocal(value);
+	else if ((type == CurvatureRadius) && (optics->type() == CurvedMirrorType))
+		dynamic_cast<CurvedMirror*>(optics)->setCurvatureRadius(value);
+	else if (type == CurvatureRadius)
+		dynamic_cast<CurvedInterface*>(optics)->setSurfaceRadius(value);
+	else if (type == IndexRatio)
+		dynamic_cast<Dielectric*>(optics)->setIndexRatio(value);
+	else if (type == A)
+		dynamic_cast<GenericABCD*>(optics)->setA(value);
+	else if (type == B)
+		dynamic_cast<GenericABCD*>(optics)->setB(value);
+	else if (type == C)
+		dynamic_cast<GenericABCD*>(optics)->setC(value);
+	else if (type == D)
+		dynamic_cast<GenericABCD*>(optics)->setD(value);
+	else if ((type == Waist) || (type == WaistPosition))
+	{
+		CreateBeam* createBeam = dynamic_cast<CreateBeam*>(optics);
+		Beam beam = *createBeam->beam();
+		if (beam.isSpherical() && (type == Waist))
+			beam.setWaist(value, Spherical);
+		else if (beam.isSpherical())
+			beam.setWaistPosition(value, Spherical);
+		else if (type == Waist)
+		{
+			beam.setWaist(value*beam.waist(Vertical)/oldValue, Vertical);
+			beam.setWaist(value, Horizontal);
+		}
+		else
+		{
+			beam.setWaistPosition(beam.waistPosition(Vertical) + value - oldValue, Vertical);
+			beam.setWaistPosition(value, Horizontal);
+		}
+		createBeam->setBeam(beam);
+	}
+
+	return true;
+}
+
 ostream& operator<<(ostream& out, const ABCD& abcd)
 {
 	if (abcd.orientation() == Spherical)
@@ -510,6 +510,29 @@ private:
 
 GenericABCD operator*(const ABCD& abcd1, const ABCD& abcd2);
 
+/**
+* Generic access to the numeric properties of optics, used to vary them
+* in tolerance analysis and parameter optimization
+*/
+namespace OpticsParameter
+{
+	/**
+	* Width applies to dielectric slabs and generic ABCD, Angle to rotable optics,
+	* Focal to lenses, CurvatureRadius to curved mirrors and interfaces, IndexRatio to dielectric optics,
+	* A, B, C and D to generic ABCD (both orientations), and Waist and WaistPosition to the input beam
+	* (horizontal value, the vertical value is changed in proportion or by the same amount).
+	*/
+	enum Type {Position = 0, Width, Angle, Focal, CurvatureRadius, IndexRatio, A, B, C, D, Waist, WaistPosition};
+
+	/// Read parameter @p type of @p optics into @p value. @return false if @p type does not apply to @p optics
+	bool get(const Optics* optics, Type type, double& value);
+	/**
+	* Set parameter @p type of @p optics to @p value. Positions respect the optics locks, as Optics::setPosition.
+	* @return false if @p type does not apply to @p optics
+	*/
+	bool set(Optics* optics, Type type, double value);
+}
+
 namespace std
 {
 	/// Sort function for stl::sort : compare optics positions
@@ -19,6 +19,8 @@
 #include "OpticsBench.h"
 #include "GaussianFit.h"
 #include "OpticsFunction.h"
+#include "ParameterFunction.h"
+#include "Parallel.h"
 #include "Utils.h"
 
 #include <iostream>
@@ -27,6 +29,7 @@
 #include <algorithm>
 #include <functional>
 #include <sstream>
+#include <thread>
 
 using namespace std;
 using namespace Utils;
@@ -98,6 +101,39 @@ void OpticsTreeItem::sort()
 /////////////////////////////////////////////////
 // OpticsBench
 
+/// Input, control and result of an optimization, possibly running on a worker thread
+struct OpticsBench::Job
+{
+	Job() : ownsOptics(false), finished(false), success(false) {}
+	~Job()
+	{
+		if (ownsOptics)
+			for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+				delete (*it);
+	}
+
+	OpticsBenchJobType type;
+	unsigned int revision;
+	// Copy of the bench
+	vector<Optics*> optics;
+	bool ownsOptics;
+	double wavelength;
+	Beam targetBeam;
+	double targetOverlap;
+	Rect boundary;
+	unsigned int seed;
+	int fitIndex;
+	Fit fit;
+	// Communication with the worker thread
+	OptimizationControl control;
+	std::atomic<bool> finished;
+	std::thread thread;
+	double reportedProgress, reportedBest;
+	// Result
+	bool success;
+	vector<double> positions;
+};
+
 OpticsBench::OpticsBench()
 {
 	m_opticsPrefix[LensType]            = "L";
@@ -111,12 +147,24 @@ OpticsBench::OpticsBench()
 	m_beamSpherical = true;
 	m_fitSpherical = true;
 	m_1D = true;
+	m_sensitivityDirty = true;
+	m_optimizationSeed = 0;
+	m_revision = 0;
+	m_job = 0;
 
 	resetDefaultValues();
 }
 
 OpticsBench::~OpticsBench()
 {
+	// Stop the running job
+	if (m_job)
+	{
+		m_job->control.cancel = true;
+		m_job->thread.join();
+		delete m_job;
+	}
+
 	// Delete optics
 	for (vector<Optics*>::iterator it = m_optics.begin(); it != m_optics.end(); it++)
 		delete (*it);
@@ -159,6 +207,9 @@ void OpticsBench::populateDefault()
 
 void OpticsBench::setModified(bool modified)
 {
+	if (modified)
+		m_revision++;
+
 	if (modified == m_modified)
 		return;
 
@@ -341,6 +392,50 @@ void OpticsBench::setWavelength(double wavelength)
 	setModified(true);
 }
 
+vector<WavelengthSweepPoint> OpticsBench::wavelengthSweep(const vector<double>& wavelengths, const vector<vector<double> >& indexRatios) const
+{
+	vector<WavelengthSweepPoint> result(wavelengths.size());
+
+	if (!indexRatios.empty() && (indexRatios.size() != wavelengths.size()))
+	{
+		cerr << "OpticsBench::wavelengthSweep: " << indexRatios.size() << " index sets for "
+		     << wavelengths.size() << " wavelengths" << endl;
+		return vector<WavelengthSweepPoint>();
+	}
+
+	// Each wavelength is propagated by its own OpticsFunction, which only reads the optics.
+	// With index data, each wavelength works on its own copy of the optics
+	auto propagate = [&](int w, int /*thread*/)
+	{
+		vector<Optics*> optics;
+		if (!indexRatios.empty())
+		{
+			optics = cloneOptics();
+			for (unsigned int i = 0; (i < optics.size()) && (i < indexRatios[w].size()); i++)
+				if (Dielectric* dielectric = dynamic_cast<Dielectric*>(optics[i]))
+					dielectric->setIndexRatio(indexRatios[w][i]);
+		}
+
+		Beam targetBeam = m_targetBeam;
+		targetBeam.setWavelength(wavelengths[w]);
+
+		OpticsFunction function(indexRatios.empty() ? m_optics : optics, wavelengths[w]);
+		function.setOverlapBeam(targetBeam);
+		const vector<double> positions = function.currentPosition();
+
+		WavelengthSweepPoint& point = result[w];
+		point.wavelength = wavelengths[w];
+		point.beam = function.beam(positions);
+		point.targetOverlap = function.value(positions);
+
+		for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+			delete (*it);
+	};
+	Parallel::forEach(wavelengths.size(), propagate, Parallel::threadCount());
+
+	return result;
+}
+
 void OpticsBench::setLeftBoundary(double leftBoundary)
 {
 	if (leftBoundary < m_boundary.x2())
@@ -475,9 +570,9 @@ int OpticsBench::setOpticsPosition(int index, double position)
 		}
 
 	// Move the optics
+	const vector<double> oldPositions = opticsPositions();
 	m_optics[index]->setPosition(position, true);
-	sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
-	computeBeams();
+	opticsMoved(oldPositions);
 
 	// Return the new index of the optics
 	for (vector<Optics*>::iterator it = m_optics.begin(); it != m_optics.end(); it++)
@@ -503,9 +598,46 @@ void OpticsBench::printTree()
 	}
 }
 
-void OpticsBench::opticsPropertyChanged(int /*index*/)
+void OpticsBench::opticsPropertyChanged(int index)
 {
-	computeBeams();
+	computeBeams(index);
+}
+
+vector<double> OpticsBench::opticsPositions() const
+{
+	vector<double> positions;
+	positions.reserve(m_optics.size());
+	for (vector<Optics*>::const_iterator it = m_optics.begin(); it != m_optics.end(); it++)
+		positions.push_back((*it)->position());
+
+	return positions;
+}
+
+void OpticsBench::opticsMoved(const vector<double>& oldPositions)
+{
+	int changedIndex = nOptics();
+	for (int i = 0; i < nOptics(); i++)
+		if (m_optics[i]->position() != oldPositions[i])
+		{
+			changedIndex = i;
+			break;
+		}
+
+	// Optics that stay within their slot do not need a re-sort
+	if (!is_sorted(m_optics.begin() + 1, m_optics.end(), less<Optics*>()))
+	{
+		const vector<Optics*> oldOrder = m_optics;
+		sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
+		for (int i = 0; i < changedIndex; i++)
+			if (m_optics[i] != oldOrder[i])
+			{
+				changedIndex = i;
+				break;
+			}
+	}
+
+	if (changedIndex < nOptics())
+		computeBeams(changedIndex);
 }
 
 /////////////////////////////////////////////////
@@ -542,9 +674,24 @@ const Beam* OpticsBench::axis(int index) const
 
 double OpticsBench::sensitivity(int index) const
 {
+	if (m_sensitivityDirty)
+		computeSensitivity();
+
 	return m_sensitivity[index];
 }
 
+void OpticsBench::computeSensitivity() const
+{
+	// The sensitivity of an optics is half the second derivative of the overlap between
+	// the output beam and the current output beam, when moving this optics alone.
+	// OpticsFunction computes it in closed form for all optics in a single pass.
+	OpticsFunction function(m_optics, m_wavelength);
+	function.setOverlapBeam(*m_beams.back());
+	function.setCheckLock(false);
+	m_sensitivity = function.curvature(function.currentPosition())/2.;
+	m_sensitivityDirty = false;
+}
+
 void OpticsBench::updateExtremeBeams()
 {
 	if (nOptics() > 0)
@@ -584,7 +731,9 @@ void OpticsBench::computeBeams(int changedIndex, bool backwards)
 			*m_beams[i] = m_optics[i]->image(*m_beams[i-1]);
 	}
 
-	for (int i = 0; i < nOptics(); i++)
+	// Beams before the changed optics are untouched, except for the stop of the preceding beam
+	const int firstChanged = backwards ? 0 : ::max(changedIndex - 1, 0);
+	for (int i = firstChanged; i < nOptics(); i++)
 	{
 		if (i != 0)
 			m_beams[i]->setStart(m_optics[i]->position() + m_optics[i]->width());
@@ -593,14 +742,11 @@ void OpticsBench::computeBeams(int changedIndex, bool backwards)
 	}
 	updateExtremeBeams();
 
-	OpticsFunction function(m_optics, m_wavelength);
-	function.setOverlapBeam(*m_beams.back());
-	function.setCheckLock(false);
-
-	m_sensitivity = function.curvature(function.currentPosition())/2.;
+	m_sensitivityDirty = true;
 
+	// The aspect scans can start at the changed optics, unless a previous optics broke the property
 	bool spherical = true;
-	for (int i = 0; i < nOptics(); i++)
+	for (int i = m_beamSpherical ? firstChanged : 0; i < nOptics(); i++)
 		if (m_optics[i]->orientation() != Spherical)
 		{
 			spherical = false;
@@ -610,7 +756,7 @@ void OpticsBench::computeBeams(int changedIndex, bool backwards)
 	m_beamSpherical = spherical;
 
 	bool oneD = true;
-	for (int i = 0; i < nOptics(); i++)
+	for (int i = m_1D ? firstChanged : 0; i < nOptics(); i++)
 	{
 		double angle = fmod(fabs(m_beams[i]->angle()), M_PI);
 		if ((angle > Utils::epsilon) && (angle < M_PI - Utils::epsilon))
@@ -718,59 +864,138 @@ void OpticsBench::setTargetOrientation(Orientation orientation)
 	setModified(true);
 }
 
-bool OpticsBench::magicWaist()
+/////////////////////////////////////////////////
+// Optimization jobs
+
+OpticsBench::Job* OpticsBench::createJob(OpticsBenchJobType type, int fitIndex, bool copyOptics) const
 {
-	OpticsFunction function(m_optics, m_wavelength);
-	function.setOverlapBeam(m_targetBeam);
-	function.setCheckLock(true);
+	Job* job = new Job;
+	job->type = type;
+	job->revision = m_revision;
+	job->wavelength = m_wavelength;
+	job->targetBeam = m_targetBeam;
+	job->targetOverlap = m_targetOverlap;
+	job->boundary = m_boundary;
+	job->seed = m_optimizationSeed;
+	job->fitIndex = fitIndex;
+	if ((type == FitJob) && (fitIndex >= 0) && (fitIndex < nFit()))
+		job->fit = *m_fits[fitIndex];
+	job->reportedProgress = job->reportedBest = 0.;
+
+	if (!copyOptics)
+	{
+		job->optics = m_optics;
+		return job;
+	}
 
-	vector<int> opticsMovable;
-	for (int i = 0; i < nOptics(); i++)
-		if (!optics(i)->absoluteLock() && !optics(i)->relativeLockParent())
-			opticsMovable.push_back(i);
+	job->ownsOptics = true;
+	job->optics = cloneOptics();
 
-	if (opticsMovable.empty())
-		return false;
+	return job;
+}
 
-	const int nTry = 500000;
-	bool found = false;
+vector<Optics*> OpticsBench::cloneOptics() const
+{
+	// Clone the optics and rebuild the locking tree
+	vector<Optics*> optics;
+	for (vector<Optics*>::const_iterator it = m_optics.begin(); it != m_optics.end(); it++)
+		optics.push_back((*it)->clone());
+	for (int child = 0; child < nOptics(); child++)
+		if (m_optics[child]->relativeLockParent())
+			optics[child]->relativeLockTo(optics[opticsIndex(m_optics[child]->relativeLockParent())]);
+
+	return optics;
+}
 
-	/// @bug this has to change !
-	const double minPos = m_boundary.x1();
-	const double maxPos = m_boundary.x2();
+void OpticsBench::runJob(Job* job)
+{
+	if (job->type == FitJob)
+	{
+		Beam beam(job->wavelength);
+		job->fit.applyFit(beam);
+		job->success = job->fit.fitAvailable(Horizontal) || job->fit.fitAvailable(Vertical);
+		job->finished = true;
+		return;
+	}
 
+	OpticsFunction function(job->optics, job->wavelength);
+	function.setOverlapBeam(job->targetBeam);
+	function.setCheckLock(true);
+	function.setControl(&job->control);
 	vector<double> positions = function.currentPosition();
 
-	for (int i = 0; i < nTry; i++)
+	if (job->type == MagicWaistJob)
 	{
-		/// @todo find a suitable RNG
-		// Randomly moves a random optics
-		int index = rand() % nOptics();
-		double position = double(rand())/double(RAND_MAX)*(maxPos - minPos) + minPos;
-		positions[index] = position;
-//		positions = function.localMaximum(positions);
+		// Optics that are not absolutely locked are searched within the bench boundaries.
+		// Moving an optics of a relative locking tree moves the whole tree.
+		/// @bug this has to change !
+		const double minPos = job->boundary.x1();
+		const double maxPos = job->boundary.x2();
+
+		vector<double> lower = positions;
+		vector<double> upper = positions;
+		bool movable = false;
+		for (unsigned int i = 0; i < job->optics.size(); i++)
+			if (!job->optics[i]->relativeLockTreeAbsoluteLock())
+			{
+				lower[i] = minPos;
+				upper[i] = maxPos;
+				movable = true;
+			}
 
 		/// @bug 2D magic waist
-		// Check waist
-		Beam beam = function.beam(positions);
-		if (Beam::overlap(beam, m_targetBeam) > m_targetOverlap)
+		if (movable)
 		{
-			cerr << "found waist : " << beam << " // try = " << i << endl;
-			found = true;
-			break;
+			function.setBounds(lower, upper);
+			function.setGoal(job->targetOverlap);
+			function.setSeed(job->seed);
+			job->positions = function.absoluteMaximum();
+			job->success = function.optimizationSuccess();
 		}
 	}
+	else if (job->type == LocalOptimumJob)
+	{
+		// Optics stay in the bench, in their order, as when moved with setOpticsPosition
+		function.setBenchConstraints(job->boundary.x1(), job->boundary.x2());
+		job->positions = function.localMaximum(positions);
+		job->success = function.optimizationSuccess();
+	}
+
+	job->finished = true;
+}
 
-	positions = function.localMaximum(positions);
+bool OpticsBench::commitJob(const Job* job)
+{
+	if (!job->success || job->control.cancel)
+		return false;
 
-	if (found)
+	if (job->type == FitJob)
 	{
-		for (unsigned int i = 0; i < positions.size(); i++)
-			m_optics[i]->setPosition(positions[i], true);
-		sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
-		computeBeams();
-    }
-	else
+		if ((job->fitIndex < 0) || (job->fitIndex >= nFit()) || !m_fits[job->fitIndex]->copyResult(job->fit))
+			return false;
+		emit(onOpticsBenchFitDataChanged(job->fitIndex));
+		return true;
+	}
+
+	if ((job->revision != m_revision) || (job->positions.size() != m_optics.size()))
+		return false;
+
+	const vector<double> oldPositions = opticsPositions();
+	for (unsigned int i = 0; i < job->positions.size(); i++)
+		m_optics[i]->setPosition(job->positions[i], true);
+	opticsMoved(oldPositions);
+
+	return true;
+}
+
+bool OpticsBench::magicWaist()
+{
+	Job* job = createJob(MagicWaistJob, 0, false);
+	runJob(job);
+	bool found = commitJob(job);
+	delete job;
+
+	if (!found)
 		cerr << "Beam not found !!!" << endl;
 
 	return found;
@@ -778,18 +1003,62 @@ bool OpticsBench::magicWaist()
 
 bool OpticsBench::localOptimum()
 {
-	OpticsFunction function(m_optics, m_wavelength);
-	function.setOverlapBeam(m_targetBeam);
-	function.setCheckLock(true);
-	vector<double> positions = function.localMaximum(function.currentPosition());
+	Job* job = createJob(LocalOptimumJob, 0, false);
+	runJob(job);
+	bool found = commitJob(job);
+	delete job;
 
-	if (!function.optimizationSuccess())
-		return false;
+	return found;
+}
 
-	for (unsigned int i = 0; i < positions.size(); i++)
-		m_optics[i]->setPosition(positions[i], true);
+void OpticsBench::applyParameters(const ParameterFunction& function, const vector<double>& x)
+{
+	function.apply(x, m_optics);
 	sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
 	computeBeams();
+}
+
+bool OpticsBench::startJob(OpticsBenchJobType type, int fitIndex)
+{
+	if (m_job)
+		return false;
+
+	m_job = createJob(type, fitIndex, true);
+	m_job->thread = std::thread(&OpticsBench::runJob, m_job);
 
 	return true;
 }
+
+void OpticsBench::cancelJob()
+{
+	if (m_job)
+		m_job->control.cancel = true;
+}
+
+void OpticsBench::processJobs()
+{
+	if (!m_job)
+		return;
+
+	const OpticsBenchJobType type = m_job->type;
+	const double progress = m_job->control.progress;
+	const double best = m_job->control.best;
+	if ((progress != m_job->reportedProgress) || (best != m_job->reportedBest))
+	{
+		m_job->reportedProgress = progress;
+		m_job->reportedBest = best;
+		emit(onOpticsBenchJobProgress(type, progress, best));
+	}
+
+	if (!m_job->finished)
+		return;
+
+	// The job is removed before committing, so that listeners see no running job
+	Job* job = m_job;
+	m_job = 0;
+	job->thread.join();
+	bool success = commitJob(job);
+	delete job;
+
+	emit(onOpticsBenchJobFinished(type, success));
+}
@@ -56,6 +56,10 @@ private:
 
 class Fit;
 class OpticsBench;
+class ParameterFunction;
+
+/// Optimizations that OpticsBench can run in the background. See OpticsBench::startJob
+enum OpticsBenchJobType {MagicWaistJob, LocalOptimumJob, FitJob};
 
 /**
 * @class OpticsBenchEvents
@@ -77,6 +81,8 @@ public:
 	virtual void onOpticsBenchSphericityChanged() {}
 	virtual void onOpticsBenchDimensionalityChanged() {}
 	virtual void onOpticsBenchModified() {}
+	virtual void onOpticsBenchJobProgress(OpticsBenchJobType /*type*/, double /*progress*/, double /*bestOverlap*/) {}
+	virtual void onOpticsBenchJobFinished(OpticsBenchJobType /*type*/, bool /*success*/) {}
 
 public:
 	const OpticsBench* bench() const { return m_bench; }
@@ -85,6 +91,16 @@ protected:
 	OpticsBench* m_bench;
 };
 
+/// Beam at the end of the bench for one wavelength of a sweep. See OpticsBench::wavelengthSweep
+struct WavelengthSweepPoint
+{
+	double wavelength;
+	/// Beam after the last optics
+	Beam beam;
+	/// Overlap of @p beam with the target beam at the same wavelength
+	double targetOverlap;
+};
+
 /**
 * OpticsBench
 */
@@ -120,6 +136,15 @@ public:
 	double wavelength() const { return m_wavelength; }
 	/// Set the bench wavelength to @p wavelength
 	void setWavelength(double wavelength);
+	/**
+	* Propagate the input beam through the bench for each wavelength of @p wavelengths, in parallel.
+	* If @p indexRatios is not empty, @p indexRatios[w][i] is the index ratio of dielectric optics @p i at
+	* wavelength @p w. The other optics ignore it, and non positive ratios keep the bench value.
+	* The bench wavelength, its beams and its listeners are left untouched.
+	* @return one point per wavelength, or nothing if @p indexRatios does not match @p wavelengths
+	*/
+	std::vector<WavelengthSweepPoint> wavelengthSweep(const std::vector<double>& wavelengths,
+		const std::vector<std::vector<double> >& indexRatios = std::vector<std::vector<double> >()) const;
 	/// @return true if the bench contains only spherical optics, i.e. if horizontal beams are identical to vertical beams
 	bool isSpherical() const;
 	/// @return true if all the beams are on the horizontal axis
@@ -179,6 +204,8 @@ public:
 	Optics* opticsForPropertyChange(int index) { return m_optics[index]; }
 	/// Call this function after changing the properties of an optics returned by opticsForPropertyChange( @p index )
 	void opticsPropertyChanged(int index);
+	/// @return a copy of the optics with the same locking tree. The caller owns the copy
+	std::vector<Optics*> cloneOptics() const;
 
 	/// Beams handling
 	const Beam* beam(int index) const;
@@ -187,6 +214,7 @@ public:
 	void setInputBeam(const Beam& beam);
 	const Beam* axis(int index) const;
 	std::pair<Beam*, double> closestPosition(const Utils::Point& point, int preferedSide = 1) const;
+	/// @return the sensitivity of the output beam to the position of optics @p index, computed on first read after a change
 	double sensitivity(int index) const;
 
 	/// Cavity
@@ -206,20 +234,53 @@ public:
 	void setTargetOverlap(double targetOverlap);
 	Orientation targetOrientation() const { return m_targetOrientation; }
 	void setTargetOrientation(Orientation orientation);
+	/// Seed of the random search of magicWaist. A given seed always gives the same result
+	unsigned int optimizationSeed() const { return m_optimizationSeed; }
+	void setOptimizationSeed(unsigned int seed) { m_optimizationSeed = seed; }
 	bool magicWaist();
 	bool localOptimum();
+	/**
+	* Set the optics parameters bound to the variables @p x of @p function, typically
+	* the result of its localMaximum or absoluteMaximum, and propagate the beams
+	*/
+	void applyParameters(const ParameterFunction& function, const std::vector<double>& x);
+
+	/// Background jobs
+	/**
+	* Start a job of type @p type on a worker thread. The job works on a copy of the bench,
+	* or of the fit @p fitIndex for a FitJob. Its progress is reported to the listeners by processJobs,
+	* which also commits its result when it is finished.
+	* The result of a magic waist or local optimum job is discarded if the bench is modified in the meantime.
+	* @return false if a job is already running
+	*/
+	bool startJob(OpticsBenchJobType type, int fitIndex = 0);
+	/// Ask the running job to stop as soon as possible. Its result is discarded
+	void cancelJob();
+	/// @return true if a job is running, or waiting for processJobs to commit its result
+	bool jobRunning() const { return m_job != 0; }
+	/// Report the progress of the running job, and commit its result when it is finished. Call regularly from the thread owning the bench
+	void processJobs();
 
 	/// Debugging
 	void printTree();
 
 private:
-	/// @todo on demand computing of beam, cavity and sensitity
+	/// @todo on demand computing of beam and cavity
+	/// Propagate the beams from optics @p changedIndex, or from beam @p changedIndex in both directions if @p backwards
 	void computeBeams(int changedIndex = 0, bool backwards = false);
+	void computeSensitivity() const;
+	std::vector<double> opticsPositions() const;
+	/// Re-sort the optics if needed after a move, and propagate from the first optics that changed
+	void opticsMoved(const std::vector<double>& oldPositions);
 	void updateExtremeBeams();
 	void detectCavities();
 	void checkFitSpherical();
 	void resetDefaultValues();
 	void notifyFitChanged(Fit* fit);
+	struct Job;
+	Job* createJob(OpticsBenchJobType type, int fitIndex, bool copyOptics) const;
+	static void runJob(Job* job);
+	bool commitJob(const Job* job);
 
 private:
 	// Properties
@@ -234,15 +295,21 @@ private:
 	Beam m_targetBeam;
 	double m_targetOverlap;
 	Orientation m_targetOrientation; // Attention : might be different from m_targetBeam.orientation()
+	unsigned int m_optimizationSeed;
 	// Cavity
 	Cavity m_cavity;
 
 	// Cache
 	std::vector<Beam*> m_beams;
-	std::vector<double> m_sensitivity;
+	mutable std::vector<double> m_sensitivity;
+	mutable bool m_sensitivityDirty;
 	bool m_beamSpherical, m_fitSpherical;
 	bool m_1D;
 	bool m_modified;
+	unsigned int m_revision;
+
+	// Background job
+	Job* m_job;
 
 	// Callback
 	std::list<OpticsBenchEventListener*> m_listeners;
@@ -22,6 +22,9 @@
 
 #include <vector>
 #include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <limits>
 
 using namespace std;
 
@@ -29,50 +32,354 @@ OpticsFunction::OpticsFunction(const std::vector<Optics*>& optics, double wavele
 	: Function()
 	, m_optics(optics)
 	, m_wavelength(wavelength)
+	, m_checkLock(false)
+	, m_snapshotValid(false)
+	, m_spherical(false)
+	, m_nRuns(0)
+	, m_validRuns(0)
 {}
 
-vector<Optics*> OpticsFunction::cloneOptics() const
+/////////////////////////////////////////////////
+// Snapshot
+
+void OpticsFunction::buildSnapshot() const
 {
-	vector<Optics*> opticsClone;
+	const int n = m_optics.size();
 
-	// Clone optics objects
-	for (vector<Optics*>::const_iterator it = m_optics.begin(); it != m_optics.end(); it++)
-		opticsClone.push_back((*it)->clone());
+	m_elements.resize(n);
+	m_basePositions.resize(n);
 
-	// Rebuild the locking tree
-	for (vector<Optics*>::const_iterator itChild = m_optics.begin(); itChild != m_optics.end(); itChild++)
-		if ((*itChild)->relativeLockParent())
-			for (vector<Optics*>::const_iterator itParent = m_optics.begin(); itParent != m_optics.end(); itParent++)
-				if ((*itParent) == (*itChild)->relativeLockParent())
-				{
-					opticsClone[itChild - m_optics.begin()]->relativeLockTo(opticsClone[itParent - m_optics.begin()]);
-					break;
-				}
+	for (int i = 0; i < n; i++)
+	{
+		const Optics* optics = m_optics[i];
+		Element& element = m_elements[i];
+
+		element.position = optics->position();
+		element.width = optics->width();
+		element.indexJump = optics->indexJump();
+		element.spherical = (optics->orientation() == Spherical);
+		element.absoluteLock = optics->relativeLockTreeAbsoluteLock();
+		element.lockGroup = i;
+		m_basePositions[i] = optics->position();
+
+		if (optics->type() == CreateBeamType)
+		{
+			// Same transformation as CreateBeam::image
+			element.kind = CreateBeamElement;
+			Beam beam = *dynamic_cast<const CreateBeam*>(optics)->beam();
+			beam.setWavelength(m_wavelength);
+			if (optics->orientation() == Spherical)
+				beam.makeSpherical();
+			element.beamQ[0] = beam.q(0., Horizontal);
+			element.beamQ[1] = beam.q(0., Vertical);
+			element.beamIndex = beam.index();
+			element.beamM2 = beam.M2();
+			element.beamSpherical = beam.isSpherical();
+		}
+		else if (optics->isABCD())
+		{
+			// Mirrors seen from their back side do not transform the beam (see FlatMirror::image)
+			const double angle = optics->angle();
+			if (((optics->type() == FlatMirrorType) || (optics->type() == CurvedMirrorType)) &&
+			    (angle > M_PI/2.) && (angle < 3.*M_PI/2.))
+				element.kind = IdentityElement;
+			else
+				element.kind = ABCDElement;
+
+			const ABCD* abcd = dynamic_cast<const ABCD*>(optics);
+			element.A[0] = abcd->A(Horizontal); element.A[1] = abcd->A(Vertical);
+			element.B[0] = abcd->B(Horizontal); element.B[1] = abcd->B(Vertical);
+			element.C[0] = abcd->C(Horizontal); element.C[1] = abcd->C(Vertical);
+			element.D[0] = abcd->D(Horizontal); element.D[1] = abcd->D(Vertical);
+		}
+		else
+		{
+			cerr << "OpticsFunction: unsupported optics " << optics->name() << " treated as identity" << endl;
+			element.kind = IdentityElement;
+		}
+	}
 
-	return opticsClone;
+	// Locking tree: each optics belongs to the group of its locking tree root
+	for (int i = 0; i < n; i++)
+	{
+		const Optics* root = m_optics[i];
+		while (root->relativeLockParent())
+			root = root->relativeLockParent();
+		for (int j = 0; j < n; j++)
+			if (m_optics[j] == root)
+			{
+				m_elements[i].lockGroup = j;
+				break;
+			}
+	}
+
+	// Compressed list of the members of each group
+	m_lockGroupStart.assign(n + 1, 0);
+	m_lockGroupMembers.resize(n);
+	for (int i = 0; i < n; i++)
+		m_lockGroupStart[m_elements[i].lockGroup + 1]++;
+	for (int g = 0; g < n; g++)
+		m_lockGroupStart[g + 1] += m_lockGroupStart[g];
+	vector<int> fill(m_lockGroupStart.begin(), m_lockGroupStart.end() - 1);
+	for (int i = 0; i < n; i++)
+		m_lockGroupMembers[fill[m_elements[i].lockGroup]++] = i;
+
+	// Input beam of the optics set
+	Beam beam;
+	beam.setWavelength(m_wavelength);
+	m_initialState.q[0] = beam.q(0., Horizontal);
+	m_initialState.q[1] = beam.q(0., Vertical);
+	m_initialState.index = beam.index();
+	m_initialState.M2 = beam.M2();
+	m_initialState.spherical = beam.isSpherical();
+
+	// With only spherical optics and beams, the vertical orientation is a copy of the horizontal one
+	m_spherical = m_initialState.spherical;
+	for (int i = 0; i < n; i++)
+		if (((m_elements[i].kind == ABCDElement) && !m_elements[i].spherical) ||
+		    ((m_elements[i].kind == CreateBeamElement) && !m_elements[i].beamSpherical))
+			m_spherical = false;
+
+	// Reset the evaluation cache
+	m_slots.resize(n);
+	for (int i = 0; i < n; i++)
+		m_slots[i] = i;
+	m_cachedSlots.assign(n, -1);
+	m_cachedPositions.assign(n, 0.);
+	m_runs.resize(n);
+	m_nRuns = 0;
+	m_validRuns = 0;
+
+	m_snapshotValid = true;
 }
 
-Beam OpticsFunction::beam(const std::vector<double>& x) const
+/////////////////////////////////////////////////
+// Evaluation
+
+void OpticsFunction::applyPositions(const vector<double>& x) const
 {
-	/// @todo cache the cloned optics
-	vector<Optics*> opticsClone = cloneOptics();
+	const int n = m_elements.size();
 
-	for (unsigned int i = 0; i < ::min(opticsClone.size(), x.size()); i++)
-		if (m_checkLock)
-			opticsClone[i]->setPosition(x[i], true);
-		else
-			opticsClone[i]->setPosition(x[i], false);
+	for (int i = 0; i < n; i++)
+		m_elements[i].position = m_basePositions[i];
 
-	sort(opticsClone.begin() + 1, opticsClone.end(), less<Optics*>());
+	// Same rules as Optics::setPosition applied successively to each optics
+	for (int i = 0; i < ::min(n, int(x.size())); i++)
+	{
+		Element& element = m_elements[i];
+		if (!m_checkLock)
+			element.position = x[i];
+		else if (!element.absoluteLock)
+		{
+			const double distance = x[i] - element.position;
+			for (int m = m_lockGroupStart[element.lockGroup]; m < m_lockGroupStart[element.lockGroup + 1]; m++)
+				m_elements[m_lockGroupMembers[m]].position += distance;
+		}
+	}
+}
 
-	Beam result;
-	result.setWavelength(m_wavelength);
+void OpticsFunction::sortSlots() const
+{
+	// Insertion sort starting from the previous order, which is usually already sorted.
+	// As in OpticsBench, the first optics is never moved
+	for (int i = 2; i < int(m_slots.size()); i++)
+	{
+		const int slot = m_slots[i];
+		const double position = m_elements[slot].position;
+		int j = i;
+		for (; (j > 1) && (m_elements[m_slots[j-1]].position > position); j--)
+			m_slots[j] = m_slots[j-1];
+		m_slots[j] = slot;
+	}
+}
+
+void OpticsFunction::splitRuns() const
+{
+	// Maximum number of optics in a run. Short runs are cheap to recompose when one of their optics moves.
+	static const int runLength = 16;
+
+	const int n = m_slots.size();
+	int nRuns = 0;
+
+	for (int start = 0; start < n; nRuns++)
+	{
+		int stop = start + 1;
+		if (m_elements[m_slots[start]].kind != CreateBeamElement)
+			while ((stop < n) && (stop - start < runLength) && (m_elements[m_slots[stop]].kind != CreateBeamElement))
+				stop++;
+
+		Run& run = m_runs[nRuns];
+		if ((nRuns >= m_nRuns) || (run.start != start) || (run.stop != stop))
+			m_validRuns = ::min(m_validRuns, nRuns);
+		run.start = start;
+		run.stop = stop;
+		start = stop;
+	}
+
+	m_nRuns = nRuns;
+}
+
+void OpticsFunction::elementMatrix(const Element& element, int orientation, double* m)
+{
+	// ABCD matrix of the optics, preceded by a free space propagation from the origin to the optics,
+	// and followed by a free space propagation from the end of the optics back to the origin
+	const int o = orientation;
+	const double z1 = element.position;
+	const double z2 = element.position + element.width;
+	m[2] = element.C[o];
+	m[3] = element.C[o]*z1 + element.D[o];
+	m[0] = element.A[o] - z2*element.C[o];
+	m[1] = element.A[o]*z1 + element.B[o] - z2*m[3];
+}
+
+void OpticsFunction::composeRun(Run& run) const
+{
+	run.indexJump = 1.;
+	run.spherical = true;
+
+	if (m_elements[m_slots[run.start]].kind == CreateBeamElement)
+		return;
+
+	for (int i = run.start; i < run.stop; i++)
+	{
+		const Element& element = m_elements[m_slots[i]];
+		if (element.kind == ABCDElement)
+		{
+			run.spherical = run.spherical && element.spherical;
+			run.indexJump *= element.indexJump;
+		}
+	}
+
+	if (run.spherical)
+	{
+		composeMatrices<1>(run);
+		for (int k = 0; k < 4; k++)
+			run.matrix[1][k] = run.matrix[0][k];
+	}
+	else
+		composeMatrices<2>(run);
+}
+
+template<int nOrientations>
+void OpticsFunction::composeMatrices(Run& run) const
+{
+	for (int o = 0; o < nOrientations; o++)
+	{
+		double* m = run.matrix[o];
+		m[0] = 1.; m[1] = 0.; m[2] = 0.; m[3] = 1.;
+	}
+
+	for (int i = run.start; i < run.stop; i++)
+	{
+		const Element& element = m_elements[m_slots[i]];
+		if (element.kind != ABCDElement)
+			continue;
+
+		for (int o = 0; o < nOrientations; o++)
+		{
+			double* m = run.matrix[o];
+			double e[4];
+			elementMatrix(element, o, e);
+			const double m0 = e[0]*m[0] + e[1]*m[2];
+			const double m1 = e[0]*m[1] + e[1]*m[3];
+			const double m2 = e[2]*m[0] + e[3]*m[2];
+			const double m3 = e[2]*m[1] + e[3]*m[3];
+			m[0] = m0; m[1] = m1; m[2] = m2; m[3] = m3;
+		}
+	}
+}
+
+void OpticsFunction::transform(const Run& run, const State& input, State& output) const
+{
+	const Element& first = m_elements[m_slots[run.start]];
+
+	// Same transformation as CreateBeam::image
+	if (first.kind == CreateBeamElement)
+	{
+		output.q[0] = first.beamQ[0];
+		output.q[1] = first.beamQ[1];
+		output.index = first.beamIndex;
+		output.M2 = first.beamM2;
+		output.spherical = first.beamSpherical;
+		return;
+	}
+
+	// Same transformation as successive ABCD::image
+	output = input;
+	output.index = input.index*run.indexJump;
+	const int nOrientations = (run.spherical && input.spherical) ? 1 : 2;
+	for (int o = 0; o < nOrientations; o++)
+	{
+		const double* m = run.matrix[o];
+		output.q[o] = (m[0]*input.q[o] + m[1])/(m[2]*input.q[o] + m[3]);
+	}
 
-	for (vector<Optics*>::const_iterator it = opticsClone.begin(); it != opticsClone.end(); it++)
-		result = (*it)->image(result);
+	if (nOrientations == 1)
+		output.q[1] = output.q[0];
+	output.spherical = (output.q[0] == output.q[1]);
+}
+
+void OpticsFunction::propagate() const
+{
+	splitRuns();
+
+	// Recompose the runs containing a moved optics, and propagate the beam from the first of them
+	bool propagating = false;
+	for (int r = 0; r < m_nRuns; r++)
+	{
+		Run& run = m_runs[r];
+		bool changed = (r >= m_validRuns);
+		for (int i = run.start; i < run.stop; i++)
+		{
+			const double position = m_elements[m_slots[i]].position;
+			if ((m_slots[i] != m_cachedSlots[i]) || (position != m_cachedPositions[i]))
+			{
+				changed = true;
+				m_cachedSlots[i] = m_slots[i];
+				m_cachedPositions[i] = position;
+			}
+		}
+
+		if (changed)
+			composeRun(run);
+		if (changed || propagating)
+			transform(run, r == 0 ? m_initialState : m_runs[r-1].output, run.output);
+		propagating = propagating || changed;
+	}
+
+	m_validRuns = m_nRuns;
+}
+
+const OpticsFunction::State& OpticsFunction::outputState(const vector<double>& x) const
+{
+	if (!m_snapshotValid)
+		buildSnapshot();
+
+	if (m_elements.empty())
+		return m_initialState;
+
+	applyPositions(x);
+	sortSlots();
+	propagate();
+
+	return m_runs[m_nRuns-1].output;
+}
+
+Beam OpticsFunction::beam(const std::vector<double>& x) const
+{
+	const State& state = outputState(x);
 
-	for (vector<Optics*>::const_iterator it = opticsClone.begin(); it != opticsClone.end(); it++)
-		delete (*it);
+	Beam result;
+	result.setWavelength(m_wavelength);
+	result.setIndex(state.index);
+	result.setM2(state.M2);
+	if (state.spherical)
+		result.setQ(state.q[0], 0., Spherical);
+	else
+	{
+		result.setQ(state.q[0], 0., Horizontal);
+		result.setQ(state.q[1], 0., Vertical);
+	}
 
 	return result;
 }
@@ -82,6 +389,91 @@ double OpticsFunction::value(const std::vector<double>& x) const
 	return Beam::overlap(m_overlapBeam, beam(x));
 }
 
+Function* OpticsFunction::clone() const
+{
+	if (!m_snapshotValid)
+		buildSnapshot();
+
+	return new OpticsFunction(*this);
+}
+
+void OpticsFunction::setBenchConstraints(double leftBoundary, double rightBoundary)
+{
+	if (!m_snapshotValid)
+		buildSnapshot();
+
+	clearConstraints();
+	const int n = m_elements.size();
+
+	// Coordinate driving each optics, and offset of the optics from this coordinate. -1 for optics that do not move
+	vector<int> driver(n, -1);
+	vector<double> offset(m_basePositions);
+	for (int i = 0; i < n; i++)
+	{
+		const Element& element = m_elements[i];
+		if (!m_checkLock)
+			driver[i] = i;
+		else if (!element.absoluteLock)
+			driver[i] = m_lockGroupMembers[m_lockGroupStart[element.lockGroup + 1] - 1];
+		if (driver[i] >= 0)
+			offset[i] = m_basePositions[i] - m_basePositions[driver[i]];
+	}
+
+	// Boundaries of each driving coordinate
+	vector<double> lower(n, -numeric_limits<double>::infinity());
+	vector<double> upper(n, numeric_limits<double>::infinity());
+	for (int i = 0; i < n; i++)
+		if (driver[i] >= 0)
+		{
+			lower[driver[i]] = ::max(lower[driver[i]], leftBoundary - offset[i]);
+			upper[driver[i]] = ::min(upper[driver[i]], rightBoundary - offset[i]);
+		}
+
+	LinearConstraint constraint;
+	constraint.indices.resize(1);
+	constraint.coefficients.resize(1);
+	for (int i = 0; i < n; i++)
+		if (driver[i] == i)
+		{
+			constraint.indices[0] = i;
+			constraint.coefficients[0] = 1.;
+			constraint.bound = upper[i];
+			addConstraint(constraint);
+			constraint.coefficients[0] = -1.;
+			constraint.bound = -lower[i];
+			addConstraint(constraint);
+		}
+
+	// Consecutive optics do not overlap. As in OpticsBench, the first optics stays first
+	vector<pair<double, int> > order;
+	for (int i = 1; i < n; i++)
+		order.push_back(make_pair(m_basePositions[i], i));
+	sort(order.begin(), order.end());
+	for (int k = 1; k < int(order.size()); k++)
+	{
+		const int a = order[k-1].second;
+		const int b = order[k].second;
+		if (driver[a] == driver[b])
+			continue;
+
+		// position(a) + width(a) <= position(b)
+		constraint.indices.clear();
+		constraint.coefficients.clear();
+		if (driver[a] >= 0)
+		{
+			constraint.indices.push_back(driver[a]);
+			constraint.coefficients.push_back(1.);
+		}
+		if (driver[b] >= 0)
+		{
+			constraint.indices.push_back(driver[b]);
+			constraint.coefficients.push_back(-1.);
+		}
+		constraint.bound = offset[b] - offset[a] - m_elements[a].width;
+		addConstraint(constraint);
+	}
+}
+
 vector<double> OpticsFunction::currentPosition() const
 {
 	vector<double> position;
@@ -91,3 +483,238 @@ vector<double> OpticsFunction::currentPosition() const
 
 	return position;
 }
+
+/////////////////////////////////////////////////
+// Derivatives
+
+/// @return 1/z, without the overflow and NaN checks of the complex division, which dominate the derivative cost
+static inline complex<double> inverse(const complex<double>& z)
+{
+	return conj(z)/norm(z);
+}
+
+OpticsFunction::Jet OpticsFunction::homography(const double* m, const Jet& z)
+{
+	// Derivatives of (a z + b)/(c z + d) by the chain rule
+	const complex<double> inverseDenominator = inverse(m[2]*z.v + m[3]);
+	const double determinant = m[0]*m[3] - m[1]*m[2];
+	const complex<double> first = determinant*inverseDenominator*inverseDenominator;
+	const complex<double> second = -2.*m[2]*first*inverseDenominator;
+
+	Jet result;
+	result.v = (m[0]*z.v + m[1])*inverseDenominator;
+	result.d1 = first*z.d1;
+	result.d2 = second*z.d1*z.d1 + first*z.d2;
+	return result;
+}
+
+void OpticsFunction::overlapConstants(double* c, double* a) const
+{
+	const State& state = m_runs[m_nRuns-1].output;
+	const double K = m_wavelength*state.M2/(state.index*M_PI);
+
+	for (int o = 0; o < 2; o++)
+	{
+		const Orientation orientation = (o == 0) ? Horizontal : Vertical;
+		c[o] = sqr(m_overlapBeam.radius(0., orientation))/K;
+		a[o] = -m_overlapBeam.waistPosition(orientation)/m_overlapBeam.rayleigh(orientation);
+	}
+}
+
+void OpticsFunction::overlapJet(const Jet* q, const double* c, const double* a, bool spherical, double& eta, double& eta1, double& eta2)
+{
+	// Same expression as Beam::overlap, written as a function of the beam parameter q at the origin:
+	// eta = -4 Im(v)/|a + i - v|^2 with v = w1^2/(K q), where w1 and a are the radius
+	// and reduced position of the overlap beam at the origin, and K q = w^2 (z - zw + i z0)/z0
+	double etaO[2][3];
+	const int nOrientations = spherical ? 1 : 2;
+	for (int o = 0; o < nOrientations; o++)
+	{
+		const complex<double> inverseQ = inverse(q[o].v);
+		const complex<double> v = c[o]*inverseQ;
+		const complex<double> v1 = -v*q[o].d1*inverseQ;
+		const complex<double> v2 = -v*q[o].d2*inverseQ + 2.*v*q[o].d1*q[o].d1*inverseQ*inverseQ;
+		const complex<double> u = complex<double>(a[o], 1.) - v;
+
+		const double D0 = norm(u);
+		const double D1 = -2.*real(conj(u)*v1);
+		const double D2 = -2.*real(conj(u)*v2) + 2.*norm(v1);
+		etaO[o][0] = -4.*v.imag()/D0;
+		etaO[o][1] = (-4.*v1.imag() - etaO[o][0]*D1)/D0;
+		etaO[o][2] = (-4.*v2.imag() - 2.*etaO[o][1]*D1 - etaO[o][0]*D2)/D0;
+	}
+
+	if (spherical)
+	{
+		eta = etaO[0][0];
+		eta1 = etaO[0][1];
+		eta2 = etaO[0][2];
+		return;
+	}
+
+	// Geometric mean of both orientations
+	const double P = etaO[0][0]*etaO[1][0];
+	const double P1 = etaO[0][1]*etaO[1][0] + etaO[0][0]*etaO[1][1];
+	const double P2 = etaO[0][2]*etaO[1][0] + 2.*etaO[0][1]*etaO[1][1] + etaO[0][0]*etaO[1][2];
+	eta = sqrt(P);
+	eta1 = eta2 = 0.;
+	if (eta > 0.)
+	{
+		eta1 = P1/(2.*eta);
+		eta2 = P2/(2.*eta) - sqr(P1)/(4.*eta*P);
+	}
+}
+
+void OpticsFunction::derivatives(const vector<double>& x, vector<double>* gradient, vector<double>* curvature) const
+{
+	if (gradient)
+		gradient->assign(x.size(), 0.);
+	if (curvature)
+		curvature->assign(x.size(), 0.);
+
+	const State& state = outputState(x);
+	const int n = m_elements.size();
+	if (n == 0)
+		return;
+
+	m_slotOf.resize(n);
+	m_slotInputs.resize(2*n);
+	m_suffixMatrices.resize(8*n);
+	m_suffixReset.resize(n);
+
+	if (m_spherical)
+		derivativesKernel<1>(x, state, gradient, curvature);
+	else
+		derivativesKernel<2>(x, state, gradient, curvature);
+}
+
+template<int nOrientations>
+void OpticsFunction::derivativesKernel(const vector<double>& x, const State& state, vector<double>* gradient, vector<double>* curvature) const
+{
+	const int n = m_elements.size();
+
+	// Beam parameter entering each slot
+	complex<double> q[2] = {m_initialState.q[0], m_initialState.q[1]};
+	for (int k = 0; k < n; k++)
+	{
+		const Element& element = m_elements[m_slots[k]];
+		m_slotOf[m_slots[k]] = k;
+		m_slotInputs[2*k] = q[0];
+		m_slotInputs[2*k+1] = q[1];
+		for (int o = 0; o < nOrientations; o++)
+			if (element.kind == CreateBeamElement)
+				q[o] = element.beamQ[o];
+			else if (element.kind == ABCDElement)
+			{
+				double m[4];
+				elementMatrix(element, o, m);
+				q[o] = (m[0]*q[o] + m[1])/(m[2]*q[o] + m[3]);
+			}
+	}
+
+	// Transformation from the output of each slot to the output of the set of optics
+	double* suffix = &m_suffixMatrices[8*(n-1)];
+	for (int o = 0; o < nOrientations; o++)
+	{
+		suffix[4*o] = 1.; suffix[4*o+1] = 0.; suffix[4*o+2] = 0.; suffix[4*o+3] = 1.;
+	}
+	m_suffixReset[n-1] = false;
+	for (int k = n - 1; k > 0; k--)
+	{
+		const Element& element = m_elements[m_slots[k]];
+		const double* next = &m_suffixMatrices[8*k];
+		double* previous = &m_suffixMatrices[8*(k-1)];
+		m_suffixReset[k-1] = m_suffixReset[k] || (element.kind == CreateBeamElement);
+		for (int o = 0; o < nOrientations; o++)
+		{
+			const double* g = next + 4*o;
+			double e[4] = {1., 0., 0., 1.};
+			if (element.kind == ABCDElement)
+				elementMatrix(element, o, e);
+			previous[4*o]   = g[0]*e[0] + g[1]*e[2];
+			previous[4*o+1] = g[0]*e[1] + g[1]*e[3];
+			previous[4*o+2] = g[2]*e[0] + g[3]*e[2];
+			previous[4*o+3] = g[2]*e[1] + g[3]*e[3];
+		}
+	}
+
+	const bool spherical = m_overlapBeam.isSpherical() && state.spherical;
+	double c[2], a[2];
+	overlapConstants(c, a);
+	const int nx = ::min(n, int(x.size()));
+	for (int i = 0; i < nx; i++)
+	{
+		// Optics moved by coordinate i, following the rules of applyPositions
+		const Element& moved = m_elements[i];
+		int first = m_slotOf[i], last = m_slotOf[i];
+		if (m_checkLock)
+		{
+			if (moved.absoluteLock)
+				continue;
+			const int* begin = &m_lockGroupMembers[m_lockGroupStart[moved.lockGroup]];
+			const int* end = &m_lockGroupMembers[0] + m_lockGroupStart[moved.lockGroup + 1];
+			bool overridden = false;
+			for (const int* member = begin; member != end; member++)
+			{
+				// A later coordinate of the same group overrides this one
+				overridden = overridden || ((*member > i) && (*member < nx));
+				first = ::min(first, m_slotOf[*member]);
+				last = ::max(last, m_slotOf[*member]);
+			}
+			if (overridden)
+				continue;
+		}
+
+		if (m_suffixReset[last])
+			continue;
+
+		// Differentiate the beam parameter from the first to the last moved optics, then through the remaining optics
+		Jet jet[2];
+		for (int o = 0; o < nOrientations; o++)
+		{
+			Jet s = {m_slotInputs[2*first+o], 0., 0.};
+			for (int k = first; k <= last; k++)
+			{
+				const int index = m_slots[k];
+				const Element& element = m_elements[index];
+				if (element.kind == CreateBeamElement)
+				{
+					s.v = element.beamQ[o];
+					s.d1 = s.d2 = 0.;
+				}
+				else if (element.kind == ABCDElement)
+				{
+					const bool member = m_checkLock ? (element.lockGroup == moved.lockGroup) : (index == i);
+					const double delta = member ? 1. : 0.;
+					const double optics[4] = {element.A[o], element.B[o], element.C[o], element.D[o]};
+					Jet input = {s.v + element.position, s.d1 + delta, s.d2};
+					s = homography(optics, input);
+					s.v -= element.position + element.width;
+					s.d1 -= delta;
+				}
+			}
+			jet[o] = homography(&m_suffixMatrices[8*last + 4*o], s);
+		}
+		if (nOrientations == 1)
+			jet[1] = jet[0];
+
+		double eta, eta1, eta2;
+		overlapJet(jet, c, a, spherical, eta, eta1, eta2);
+		if (gradient)
+			(*gradient)[i] = eta1;
+		if (curvature)
+			(*curvature)[i] = eta2;
+	}
+}
+
+void OpticsFunction::gradient(const vector<double>& x, vector<double>& result) const
+{
+	derivatives(x, &result, 0);
+}
+
+vector<double> OpticsFunction::curvature(const vector<double>& x) const
+{
+	vector<double> result;
+	derivatives(x, 0, &result);
+	return result;
+}
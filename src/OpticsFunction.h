@@ -22,6 +22,8 @@
 #include "Function.h"
 #include "GaussianBeam.h"
 
+#include <complex>
+
 class Optics;
 class OpticsBench;
 
@@ -29,6 +31,16 @@ class OpticsBench;
 * Optics function is a function which value is the overlap between a Gaussian beam
 * produced by a set of optics and a given beam. Its arguments is the set of positions
 * of all the optics.
+*
+* The optics are not cloned at each evaluation: a flat snapshot of the bench (positions,
+* ABCD coefficients for each orientation and locking tree) is taken on the first evaluation
+* and reused afterwards. Consecutive ABCD optics, including the free space between them,
+* are folded into runs whose composed ABCD matrix is cached for each orientation.
+* An evaluation only recomposes the runs containing an optics that moved, and propagates
+* the beam from the first of these runs.
+* The gradient and curvature are computed analytically, by differentiating the beam parameter
+* through the ABCD chain and then the overlap with respect to each optics position.
+* Call invalidateSnapshot() if the optics given to the constructor are modified.
 */
 class OpticsFunction : public Function
 {
@@ -38,20 +50,130 @@ public:
 
 public:
 	virtual double value(const std::vector<double>& x) const;
+	using Function::gradient;
+	virtual void gradient(const std::vector<double>& x, std::vector<double>& result) const;
+	virtual bool hasGradient() const { return true; }
+	virtual std::vector<double> curvature(const std::vector<double>& x) const;
+	/// The copy shares the snapshot taken so far, and does not access the optics anymore
+	virtual Function* clone() const;
 	/// @todo this should be private
 	Beam beam(const std::vector<double>& x) const;
 	std::vector<double> currentPosition() const;
 	void setCheckLock(bool checkLock) { m_checkLock = checkLock; }
 	void setOverlapBeam(const Beam& beam) { m_overlapBeam = beam; }
+	/// Discard the bench snapshot. It will be rebuilt from the optics at the next evaluation
+	void invalidateSnapshot() { m_snapshotValid = false; }
+	/**
+	* Constrain localExtremum to keep the optics within [@p leftBoundary, @p rightBoundary], in their current order
+	* and without overlapping, as OpticsBench::setOpticsPosition does. With lock checking, each relative locking tree
+	* moves as a whole, driven by the coordinate of its last optics, and absolutely locked trees do not move.
+	* The constraints are built from the current optics positions, and replace previous constraints.
+	*/
+	void setBenchConstraints(double leftBoundary, double rightBoundary);
+
+private:
+	/// Evaluation rule of a flat optics
+	enum ElementKind {CreateBeamElement, ABCDElement, IdentityElement};
+
+	/// Flat copy of an optics
+	struct Element
+	{
+		ElementKind kind;
+		double position;
+		double width;
+		double indexJump;
+		bool spherical;
+		// ABCD coefficients, for the horizontal [0] and vertical [1] orientations
+		double A[2], B[2], C[2], D[2];
+		// Locking tree
+		bool absoluteLock;
+		int lockGroup;
+		// Beam produced by a CreateBeam element
+		std::complex<double> beamQ[2];
+		double beamIndex, beamM2;
+		bool beamSpherical;
+	};
+
+	/// Beam after a given optics. q holds the complex beam parameter at the origin of the optical axis
+	struct State
+	{
+		std::complex<double> q[2];
+		double index, M2;
+		bool spherical;
+	};
+
+	/**
+	* Consecutive slots folded into a single transformation. A run is either a single CreateBeam
+	* or a sequence of ABCD optics. In the latter case, matrix holds for each orientation
+	* the composed ABCD matrix (A, B, C, D) acting on the beam parameter at the origin of the optical axis,
+	* i.e. including the free space propagation to and from each optics.
+	* @note contrary to ABCD::image, the composition does not freeze the waist of non physical
+	* intermediate beams (negative Rayleigh range)
+	*/
+	struct Run
+	{
+		int start, stop;
+		double matrix[2][4];
+		double indexJump;
+		bool spherical;
+		State output;
+	};
+
+	/// Value, first and second derivatives of a complex quantity with respect to a single position
+	struct Jet
+	{
+		std::complex<double> v, d1, d2;
+	};
 
 private:
-	std::vector<Optics*> cloneOptics() const;
+	void buildSnapshot() const;
+	void applyPositions(const std::vector<double>& x) const;
+	void sortSlots() const;
+	void propagate() const;
+	void splitRuns() const;
+	void composeRun(Run& run) const;
+	/// Compose the matrices of @p run for the first @p nOrientations orientations
+	template<int nOrientations> void composeMatrices(Run& run) const;
+	void transform(const Run& run, const State& input, State& output) const;
+	const State& outputState(const std::vector<double>& x) const;
+	static void elementMatrix(const Element& element, int orientation, double* m);
+	static Jet homography(const double* m, const Jet& z);
+	/// Constants of the overlap with m_overlapBeam, for each orientation: squared radius over K, and reduced position, at the origin
+	void overlapConstants(double* c, double* a) const;
+	static void overlapJet(const Jet* q, const double* c, const double* a, bool spherical, double& eta, double& eta1, double& eta2);
+	void derivatives(const std::vector<double>& x, std::vector<double>* gradient, std::vector<double>* curvature) const;
+	/// Derivatives computed for the first @p nOrientations orientations. The vertical jets are copied from the horizontal ones if @p nOrientations is 1
+	template<int nOrientations> void derivativesKernel(const std::vector<double>& x, const State& state, std::vector<double>* gradient, std::vector<double>* curvature) const;
 
 private:
 	const std::vector<Optics*>& m_optics;
 	double m_wavelength;
 	bool m_checkLock;
 	Beam m_overlapBeam;
+
+	// Snapshot
+	mutable bool m_snapshotValid;
+	/// All the optics and beams of the snapshot are spherical
+	mutable bool m_spherical;
+	mutable std::vector<Element> m_elements;
+	mutable std::vector<double> m_basePositions;
+	mutable std::vector<int> m_lockGroupStart;
+	mutable std::vector<int> m_lockGroupMembers;
+	mutable State m_initialState;
+
+	// Evaluation cache
+	mutable std::vector<int> m_slots;
+	mutable std::vector<int> m_cachedSlots;
+	mutable std::vector<double> m_cachedPositions;
+	mutable std::vector<Run> m_runs;
+	mutable int m_nRuns;
+	mutable int m_validRuns;
+
+	// Derivative buffers
+	mutable std::vector<int> m_slotOf;
+	mutable std::vector<std::complex<double> > m_slotInputs;
+	mutable std::vector<double> m_suffixMatrices;
+	mutable std::vector<bool> m_suffixReset;
 };
 
 #endif
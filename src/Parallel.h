@@ -0,0 +1,65 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+
+/// @return the number of worker threads used by parallel loops
+inline int threadCount()
+{
+	const int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+/**
+* Call @p task(index, thread) for each index in [0, @p count).
+* Indices are handed out one at a time to the first idle thread, so that
+* uneven tasks are balanced between threads. @p thread is the index of the
+* calling worker thread, in [0, @p nThreads), and can be used to address per-thread data.
+* @p task has to be thread safe. It is called from the calling thread when @p nThreads is 1.
+*/
+template<typename Task> void forEach(int count, Task& task, int nThreads)
+{
+	nThreads = std::max(1, std::min(nThreads, count));
+
+	std::atomic<int> next(0);
+	auto worker = [&](int thread)
+	{
+		for (int index = next++; index < count; index = next++)
+			task(index, thread);
+	};
+
+	std::vector<std::thread> threads;
+	for (int thread = 1; thread < nThreads; thread++)
+		threads.push_back(std::thread(worker, thread));
+	worker(0);
+	for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); it++)
+		it->join();
+}
+
+}
+
+#endif
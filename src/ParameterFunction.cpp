@@ -0,0 +1,193 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "ParameterFunction.h"
+#include "OpticsBench.h"
+#include "OpticsFunction.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+ParameterFunction::ParameterFunction(const OpticsBench& bench)
+	: Function()
+	, m_optics(bench.cloneOptics())
+	, m_wavelength(bench.wavelength())
+	, m_overlapBeam(*bench.targetBeam())
+{
+	m_function = new OpticsFunction(m_optics, m_wavelength);
+	m_function->setOverlapBeam(m_overlapBeam);
+	m_positions.resize(m_optics.size());
+}
+
+ParameterFunction::ParameterFunction(const ParameterFunction& other)
+	: Function(other)
+	, m_wavelength(other.m_wavelength)
+	, m_overlapBeam(other.m_overlapBeam)
+	, m_bindings(other.m_bindings)
+	, m_initial(other.m_initial)
+	, m_lower(other.m_lower)
+	, m_upper(other.m_upper)
+	, m_bounded(other.m_bounded)
+	, m_appliedValues(other.m_appliedValues)
+	, m_positions(other.m_positions)
+{
+	// Clone the optics and rebuild the locking tree
+	for (vector<Optics*>::const_iterator it = other.m_optics.begin(); it != other.m_optics.end(); it++)
+		m_optics.push_back((*it)->clone());
+	for (unsigned int child = 0; child < m_optics.size(); child++)
+		if (other.m_optics[child]->relativeLockParent())
+		{
+			const int parent = find(other.m_optics.begin(), other.m_optics.end(), other.m_optics[child]->relativeLockParent()) - other.m_optics.begin();
+			m_optics[child]->relativeLockTo(m_optics[parent]);
+		}
+
+	m_function = new OpticsFunction(m_optics, m_wavelength);
+	m_function->setOverlapBeam(m_overlapBeam);
+}
+
+ParameterFunction::~ParameterFunction()
+{
+	delete m_function;
+	for (vector<Optics*>::iterator it = m_optics.begin(); it != m_optics.end(); it++)
+		delete (*it);
+}
+
+int ParameterFunction::addVariable(int index, OpticsParameter::Type type)
+{
+	double value;
+	if ((index < 0) || (index >= int(m_optics.size())) || !OpticsParameter::get(m_optics[index], type, value))
+	{
+		cerr << "ParameterFunction: parameter " << type << " does not apply to optics " << index << endl;
+		return -1;
+	}
+
+	Binding binding;
+	binding.index = index;
+	binding.type = type;
+	binding.variable = m_initial.size();
+	binding.factor = 1.;
+	binding.offset = 0.;
+	m_bindings.push_back(binding);
+	m_appliedValues.push_back(value);
+
+	m_initial.push_back(value);
+	m_lower.push_back(value);
+	m_upper.push_back(value);
+	m_bounded.push_back(false);
+	updateBounds();
+
+	return binding.variable;
+}
+
+bool ParameterFunction::setVariableBounds(int variable, double lower, double upper)
+{
+	if ((variable < 0) || (variable >= nVariables()) || (lower > upper))
+		return false;
+
+	m_lower[variable] = lower;
+	m_upper[variable] = upper;
+	m_bounded[variable] = true;
+	updateBounds();
+
+	return true;
+}
+
+bool ParameterFunction::tie(int index, OpticsParameter::Type type, int variable, double factor, double offset)
+{
+	double value;
+	if ((variable < 0) || (variable >= nVariables()) ||
+	    (index < 0) || (index >= int(m_optics.size())) || !OpticsParameter::get(m_optics[index], type, value))
+	{
+		cerr << "ParameterFunction: cannot tie parameter " << type << " of optics " << index << " to variable " << variable << endl;
+		return false;
+	}
+
+	Binding binding;
+	binding.index = index;
+	binding.type = type;
+	binding.variable = variable;
+	binding.factor = factor;
+	binding.offset = offset;
+	m_bindings.push_back(binding);
+	m_appliedValues.push_back(value);
+
+	return true;
+}
+
+void ParameterFunction::setOverlapBeam(const Beam& beam)
+{
+	m_overlapBeam = beam;
+	m_function->setOverlapBeam(beam);
+}
+
+void ParameterFunction::updateBounds()
+{
+	// Free variables are held at their initial value by absoluteExtremum
+	vector<double> lower = m_initial, upper = m_initial;
+	for (int v = 0; v < nVariables(); v++)
+		if (m_bounded[v])
+		{
+			lower[v] = m_lower[v];
+			upper[v] = m_upper[v];
+		}
+
+	setBounds(lower, upper);
+}
+
+double ParameterFunction::variable(const vector<double>& x, int variable) const
+{
+	if (m_bounded[variable])
+		return ::min(m_upper[variable], ::max(m_lower[variable], x[variable]));
+
+	return x[variable];
+}
+
+double ParameterFunction::value(const vector<double>& x) const
+{
+	// Positions are set at each evaluation, in the binding order, since moving an optics may move its locked optics.
+	// Other parameters are only set when they change, and invalidate the snapshot of the optics
+	bool propertyChanged = false;
+	for (unsigned int b = 0; b < m_bindings.size(); b++)
+	{
+		const Binding& binding = m_bindings[b];
+		const double parameter = binding.factor*variable(x, binding.variable) + binding.offset;
+		if ((binding.type != OpticsParameter::Position) && (parameter == m_appliedValues[b]))
+			continue;
+
+		OpticsParameter::set(m_optics[binding.index], binding.type, parameter);
+		m_appliedValues[b] = parameter;
+		propertyChanged = propertyChanged || (binding.type != OpticsParameter::Position);
+	}
+
+	if (propertyChanged)
+		m_function->invalidateSnapshot();
+
+	for (unsigned int i = 0; i < m_optics.size(); i++)
+		m_positions[i] = m_optics[i]->position();
+
+	return m_function->value(m_positions);
+}
+
+void ParameterFunction::apply(const vector<double>& x, const vector<Optics*>& optics) const
+{
+	for (vector<Binding>::const_iterator binding = m_bindings.begin(); binding != m_bindings.end(); binding++)
+		if (binding->index < int(optics.size()))
+			OpticsParameter::set(optics[binding->index], binding->type, binding->factor*variable(x, binding->variable) + binding->offset);
+}
@@ -0,0 +1,106 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PARAMETERFUNCTION_H
+#define PARAMETERFUNCTION_H
+
+#include "Function.h"
+#include "Optics.h"
+#include "GaussianBeam.h"
+
+#include <vector>
+
+class OpticsBench;
+class OpticsFunction;
+
+/**
+* Overlap between the output beam of a bench and a target beam, as a function of
+* a set of variables bound to optics parameters (see OpticsParameter).
+* Each variable drives one optics parameter, and other parameters can be tied to it
+* by an affine relation. A variable is either free, or bounded. Bounded variables are searched
+* by absoluteMaximum, and clamped to their bounds when the function is evaluated. Free variables
+* keep their initial value in absoluteMaximum, and are only moved by localMaximum.
+* The function works on its own copy of the optics: apply the result to a bench with OpticsBench::applyParameters.
+*/
+class ParameterFunction : public Function
+{
+public:
+	/// Build a function on a copy of the optics of @p bench, with the bench wavelength and target beam
+	ParameterFunction(const OpticsBench& bench);
+	ParameterFunction(const ParameterFunction& other);
+	virtual ~ParameterFunction();
+	/// Not assignable: the function owns its copy of the optics. Use clone()
+	ParameterFunction& operator=(const ParameterFunction& other) = delete;
+
+public:
+	virtual double value(const std::vector<double>& x) const;
+	virtual Function* clone() const { return new ParameterFunction(*this); }
+
+	/**
+	* Add a free variable driving parameter @p type of optics @p index. Its initial value is the current parameter value.
+	* @return the index of the variable, or -1 if the parameter does not apply to the optics
+	*/
+	int addVariable(int index, OpticsParameter::Type type);
+	/// Bound variable @p variable to [@p lower, @p upper]. @return false if @p variable does not exist or if the bounds are empty
+	bool setVariableBounds(int variable, double lower, double upper);
+	/**
+	* Tie parameter @p type of optics @p index to variable @p variable: parameter = @p factor * variable + @p offset
+	* @return false if the variable does not exist, or if the parameter does not apply to the optics
+	*/
+	bool tie(int index, OpticsParameter::Type type, int variable, double factor = 1., double offset = 0.);
+	/// @return the number of variables
+	int nVariables() const { return m_initial.size(); }
+	/// @return the initial value of the variables
+	const std::vector<double>& initialValues() const { return m_initial; }
+	/// Set the beam whose overlap with the output beam is computed. Defaults to the bench target beam
+	void setOverlapBeam(const Beam& beam);
+
+	/// Set the parameters bound to the variables of @p x on @p optics, which has the same layout as the bench
+	void apply(const std::vector<double>& x, const std::vector<Optics*>& optics) const;
+
+private:
+	/// Optics parameter driven by a variable
+	struct Binding
+	{
+		int index;
+		OpticsParameter::Type type;
+		int variable;
+		double factor, offset;
+	};
+
+private:
+	/// @return the value of variable @p variable in @p x, clamped to its bounds
+	double variable(const std::vector<double>& x, int variable) const;
+	void updateBounds();
+
+private:
+	std::vector<Optics*> m_optics;
+	double m_wavelength;
+	Beam m_overlapBeam;
+	OpticsFunction* m_function;
+	std::vector<Binding> m_bindings;
+	std::vector<double> m_initial;
+	std::vector<double> m_lower, m_upper;
+	std::vector<bool> m_bounded;
+
+	// Evaluation cache: parameter values last set on the optics
+	mutable std::vector<double> m_appliedValues;
+	mutable std::vector<double> m_positions;
+};
+
+#endif
@@ -23,6 +23,11 @@
 
 #include <vector>
 
+/**
+* Means, variances and linear regression of a set of points (x, y).
+* Points are accumulated one at a time with Welford's algorithm, which is numerically stable
+* and updates all the statistics in constant time.
+*/
 class Statistics
 {
 public:
@@ -36,34 +41,58 @@ public:
 	double m, p;
 
 public:
+	/// Empty set of points
+	Statistics()
+	{
+		clear();
+	}
+
 	Statistics(const std::vector<double>& X, const std::vector<double>& Y)
 	{
-		unsigned int size = X.size();
-		meanX = meanY = VX = VY = XY = 0.0;
+		clear();
+		for(unsigned int i = 0; i < X.size(); i++)
+			add(X[i], Y[i]);
+	}
 
-		for(unsigned int i = 0; i < size; i++)
-		{
-				meanX += X[i];
-				meanY += Y[i];
-				VX += sqr(X[i]);
-				VY += sqr(Y[i]);
-				XY += X[i]*Y[i];
-		}
+	/// Remove all points
+	void clear()
+	{
+		m_size = 0;
+		meanX = meanY = VX = VY = XY = rho2 = m = p = 0.0;
+		m_sumX2 = m_sumY2 = m_sumXY = 0.0;
+	}
+
+	/// Add point (@p x, @p y)
+	void add(double x, double y)
+	{
+		m_size++;
+		const double dx = x - meanX;
+		const double dy = y - meanY;
+		meanX += dx/m_size;
+		meanY += dy/m_size;
+		// Sums of the squared deviations from the mean
+		m_sumX2 += dx*(x - meanX);
+		m_sumY2 += dy*(y - meanY);
+		m_sumXY += dx*(y - meanY);
 
-		// Mean
-		meanX /= size;
-		meanY /= size;
 		// Correlations
-		XY = (XY - meanX*meanY*size)/(size - 1.0);
+		XY = m_sumXY/(m_size - 1.0);
 		// Variance
-		VX = (VX-sqr(meanX)*size)/(size-1.0);
-		VY = (VY-sqr(meanY)*size)/(size-1.0);
+		VX = m_sumX2/(m_size - 1.0);
+		VY = m_sumY2/(m_size - 1.0);
 		// Correlation coefficient
 		rho2 = sqr(XY)/(VX * VY);
 		// Linear Fit
 		m = XY/VX;
 		p = meanY - m*meanX;
 	}
+
+	/// @return the number of points
+	int size() const { return m_size; }
+
+private:
+	int m_size;
+	double m_sumX2, m_sumY2, m_sumXY;
 };
 
 #endif
@@ -0,0 +1,208 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "ToleranceAnalysis.h"
+#include "OpticsBench.h"
+#include "OpticsFunction.h"
+#include "Parallel.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace std;
+
+/// Statistics of the overlap of a chunk of samples
+struct ToleranceAnalysis::Chunk
+{
+	int count;
+	/// Mean overlap, and sum of the squared deviations from it, updated by Welford's algorithm
+	double mean, squaredDeviations;
+	double min, max;
+	int yieldCount;
+	vector<int> histogram;
+};
+
+ToleranceAnalysis::ToleranceAnalysis(const OpticsBench& bench)
+	: m_bench(bench)
+	, m_sampleCount(100000)
+	, m_seed(0)
+	, m_yieldThreshold(bench.targetOverlap())
+	, m_histogramBins(100)
+	, m_threadCount(Parallel::threadCount())
+	, m_nominalOverlap(0.)
+	, m_meanOverlap(0.)
+	, m_overlapDeviation(0.)
+	, m_minOverlap(0.)
+	, m_maxOverlap(0.)
+	, m_yield(0.)
+{}
+
+bool ToleranceAnalysis::addTolerance(int index, OpticsParameter::Type parameter, ToleranceDistribution distribution, double width)
+{
+	double value;
+	if ((index < 0) || (index >= m_bench.nOptics()) || !OpticsParameter::get(m_bench.optics(index), parameter, value))
+	{
+		cerr << "ToleranceAnalysis: parameter " << parameter << " does not apply to optics " << index << endl;
+		return false;
+	}
+
+	Tolerance tolerance;
+	tolerance.index = index;
+	tolerance.parameter = parameter;
+	tolerance.distribution = distribution;
+	tolerance.width = width;
+	m_tolerances.push_back(tolerance);
+
+	return true;
+}
+
+bool ToleranceAnalysis::run()
+{
+	static const int chunkSize = 1024;
+
+	const int nTolerances = m_tolerances.size();
+	if ((m_sampleCount <= 0) || (m_bench.nOptics() == 0))
+		return false;
+
+	// Nominal values, read from the bench since it may have changed since addTolerance
+	vector<double> nominal(nTolerances);
+	for (int t = 0; t < nTolerances; t++)
+		if ((m_tolerances[t].index >= m_bench.nOptics()) ||
+		    !OpticsParameter::get(m_bench.optics(m_tolerances[t].index), m_tolerances[t].parameter, nominal[t]))
+		{
+			cerr << "ToleranceAnalysis: tolerance " << t << " does not apply to the bench anymore" << endl;
+			return false;
+		}
+
+	// Each thread works on its own copy of the optics
+	const int nChunks = (m_sampleCount + chunkSize - 1)/chunkSize;
+	const int nThreads = ::max(1, ::min(m_threadCount, nChunks));
+	vector<vector<Optics*> > optics(nThreads);
+	vector<OpticsFunction*> functions(nThreads);
+	for (int thread = 0; thread < nThreads; thread++)
+	{
+		optics[thread] = m_bench.cloneOptics();
+		functions[thread] = new OpticsFunction(optics[thread], m_bench.wavelength());
+		functions[thread]->setOverlapBeam(*m_bench.targetBeam());
+	}
+	const vector<double> positions = functions[0]->currentPosition();
+	m_nominalOverlap = functions[0]->value(positions);
+
+	vector<Chunk> chunks(nChunks);
+	auto sample = [&](int c, int thread)
+	{
+		OpticsFunction* function = functions[thread];
+		seed_seq sequence = {m_seed, (unsigned int)(c)};
+		mt19937 random(sequence);
+		vector<double> x;
+
+		Chunk& chunk = chunks[c];
+		chunk.count = chunk.yieldCount = 0;
+		chunk.mean = chunk.squaredDeviations = 0.;
+		chunk.min = numeric_limits<double>::infinity();
+		chunk.max = -numeric_limits<double>::infinity();
+		chunk.histogram.assign(m_histogramBins, 0);
+
+		const int stop = ::min(m_sampleCount, (c + 1)*chunkSize);
+		for (int s = c*chunkSize; s < stop; s++)
+		{
+			x = positions;
+			bool propertyChanged = false;
+			for (int t = 0; t < nTolerances; t++)
+			{
+				const Tolerance& tolerance = m_tolerances[t];
+				const double u = (random() + 0.5)/4294967296.;
+				double error;
+				if (tolerance.distribution == GaussianDistribution)
+				{
+					// Box-Muller transform, rather than std::normal_distribution whose output depends on the standard library
+					const double v = (random() + 0.5)/4294967296.;
+					error = tolerance.width*sqrt(-2.*log(u))*cos(2.*M_PI*v);
+				}
+				else
+					error = tolerance.width*(2.*u - 1.);
+
+				if (tolerance.parameter == OpticsParameter::Position)
+					x[tolerance.index] += error;
+				else
+				{
+					OpticsParameter::set(optics[thread][tolerance.index], tolerance.parameter, nominal[t] + error);
+					propertyChanged = true;
+				}
+			}
+
+			if (propertyChanged)
+				function->invalidateSnapshot();
+			double overlap = function->value(x);
+			if (!(overlap >= 0.))
+				overlap = 0.;
+
+			chunk.count++;
+			const double delta = overlap - chunk.mean;
+			chunk.mean += delta/chunk.count;
+			chunk.squaredDeviations += delta*(overlap - chunk.mean);
+			chunk.min = ::min(chunk.min, overlap);
+			chunk.max = ::max(chunk.max, overlap);
+			if (overlap >= m_yieldThreshold)
+				chunk.yieldCount++;
+			chunk.histogram[::min(int(overlap*m_histogramBins), m_histogramBins - 1)]++;
+		}
+	};
+	Parallel::forEach(nChunks, sample, nThreads);
+
+	for (int thread = 0; thread < nThreads; thread++)
+	{
+		delete functions[thread];
+		for (vector<Optics*>::iterator it = optics[thread].begin(); it != optics[thread].end(); it++)
+			delete (*it);
+	}
+
+	// Merge the chunks in a fixed order. Means and squared deviations are merged pairwise (Chan et al.), which
+	// does not lose the deviation to cancellation when it is small compared to the mean overlap
+	int count = 0, yieldCount = 0;
+	double mean = 0., squaredDeviations = 0.;
+	m_minOverlap = numeric_limits<double>::infinity();
+	m_maxOverlap = -numeric_limits<double>::infinity();
+	m_histogram.assign(m_histogramBins, 0);
+	for (vector<Chunk>::const_iterator chunk = chunks.begin(); chunk != chunks.end(); chunk++)
+	{
+		if (chunk->count > 0)
+		{
+			const double delta = chunk->mean - mean;
+			const double merged = count + chunk->count;
+			mean += delta*chunk->count/merged;
+			squaredDeviations += chunk->squaredDeviations + sqr(delta)*count*chunk->count/merged;
+		}
+		count += chunk->count;
+		yieldCount += chunk->yieldCount;
+		m_minOverlap = ::min(m_minOverlap, chunk->min);
+		m_maxOverlap = ::max(m_maxOverlap, chunk->max);
+		for (int bin = 0; bin < m_histogramBins; bin++)
+			m_histogram[bin] += chunk->histogram[bin];
+	}
+
+	m_meanOverlap = mean;
+	m_overlapDeviation = count > 1 ? sqrt(squaredDeviations/(count - 1.)) : 0.;
+	m_yield = double(yieldCount)/double(count);
+
+	return true;
+}
@@ -0,0 +1,122 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef TOLERANCEANALYSIS_H
+#define TOLERANCEANALYSIS_H
+
+#include "Optics.h"
+
+#include <vector>
+
+class OpticsBench;
+
+/// Distribution of the errors of a tolerance
+enum ToleranceDistribution {GaussianDistribution, UniformDistribution};
+
+/**
+* Monte-Carlo analysis of the overlap between the output beam of a bench and its target beam,
+* when the optics properties are drawn from random distributions around their nominal values.
+* Samples are drawn by chunks, each chunk having its own random generator seeded by the seed
+* and the chunk index. Chunks are evaluated in parallel, and their statistics are merged
+* in chunk order, so that the results for a given seed do not depend on the number of threads.
+* Position tolerances only move the optics of the bench snapshot evaluated by OpticsFunction, whereas any other
+* tolerance modifies the optics, and the whole snapshot is rebuilt for each sample: such analyses are about three times slower.
+* The bench is copied when run() starts, and is not modified.
+*/
+class ToleranceAnalysis
+{
+public:
+	ToleranceAnalysis(const OpticsBench& bench);
+
+public:
+	/**
+	* Add a tolerance on @p parameter of optics @p index. Errors are drawn from @p distribution,
+	* @p width being its standard deviation for GaussianDistribution, or its half width for UniformDistribution.
+	* Errors are absolute, in the unit of the parameter. Position errors ignore the optics locks.
+	* @return false if the parameter does not apply to the optics
+	*/
+	bool addTolerance(int index, OpticsParameter::Type parameter, ToleranceDistribution distribution, double width);
+	/// Remove all tolerances
+	void clearTolerances() { m_tolerances.clear(); }
+	/// @return the number of tolerances
+	int nTolerances() const { return m_tolerances.size(); }
+
+	/// Number of random configurations drawn by run()
+	int sampleCount() const { return m_sampleCount; }
+	void setSampleCount(int sampleCount) { m_sampleCount = sampleCount; }
+	/// A given seed always gives the same results
+	unsigned int seed() const { return m_seed; }
+	void setSeed(unsigned int seed) { m_seed = seed; }
+	/// Minimum overlap of a configuration counted in yield(). Defaults to the bench target overlap
+	double yieldThreshold() const { return m_yieldThreshold; }
+	void setYieldThreshold(double yieldThreshold) { m_yieldThreshold = yieldThreshold; }
+	/// Number of bins of the overlap histogram, that covers [0, 1]
+	int histogramBins() const { return m_histogramBins; }
+	void setHistogramBins(int histogramBins) { m_histogramBins = histogramBins > 0 ? histogramBins : 1; }
+	/// Maximum number of threads used by run()
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+
+	/**
+	* Draw sampleCount() configurations and compute the statistics of their overlap with the target beam.
+	* @return false if the sample count is not positive, if the bench is empty, or if a tolerance does not apply to the bench anymore
+	*/
+	bool run();
+
+	// Results of the last run
+
+	/// Overlap of the unperturbed bench
+	double nominalOverlap() const { return m_nominalOverlap; }
+	double meanOverlap() const { return m_meanOverlap; }
+	double overlapDeviation() const { return m_overlapDeviation; }
+	double minOverlap() const { return m_minOverlap; }
+	double maxOverlap() const { return m_maxOverlap; }
+	/// Fraction of the configurations whose overlap is at least yieldThreshold()
+	double yield() const { return m_yield; }
+	/// Number of configurations in each overlap bin. Bin i covers [i, i+1)/histogramBins(), the last bin includes 1
+	const std::vector<int>& histogram() const { return m_histogram; }
+
+private:
+	struct Tolerance
+	{
+		int index;
+		OpticsParameter::Type parameter;
+		ToleranceDistribution distribution;
+		double width;
+	};
+	struct Chunk;
+
+private:
+	const OpticsBench& m_bench;
+	std::vector<Tolerance> m_tolerances;
+	int m_sampleCount;
+	unsigned int m_seed;
+	double m_yieldThreshold;
+	int m_histogramBins;
+	int m_threadCount;
+
+	// Results
+	double m_nominalOverlap;
+	double m_meanOverlap;
+	double m_overlapDeviation;
+	double m_minOverlap;
+	double m_maxOverlap;
+	double m_yield;
+	std::vector<int> m_histogram;
+};
+
+#endif
@@ -0,0 +1,58 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+
+/**
+* Diagnostic traces of the computation code.
+* A trace is written to the standard error if its level is lower or equal to both
+* the compile time level GAUSSIANBEAM_TRACE_LEVEL and the runtime level Trace::level().
+* Traces above the compile time level are removed by the compiler, including the evaluation
+* of their message, so that they cost nothing in hot loops.
+*/
+namespace Trace
+{
+	enum Level {None = 0, Info, Debug};
+
+	/// @return the runtime trace level
+	inline Level& level()
+	{
+		static Level currentLevel = Info;
+		return currentLevel;
+	}
+
+	/// Set the runtime trace level
+	inline void setLevel(Level newLevel) { level() = newLevel; }
+}
+
+/// Compile time trace level. Define it to Trace::Debug to compile the debugging traces in
+#ifndef GAUSSIANBEAM_TRACE_LEVEL
+#define GAUSSIANBEAM_TRACE_LEVEL Trace::Info
+#endif
+
+/// Write @p message, a sequence of stream insertions, if the trace @p traceLevel is enabled
+#define TRACE(traceLevel, message) \
+	do { \
+		if (((traceLevel) <= GAUSSIANBEAM_TRACE_LEVEL) && ((traceLevel) <= Trace::level())) \
+			std::cerr << message << std::endl; \
+	} while (0)
+
+#endif
@@ -0,0 +1,165 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/// Round trip of GaussianBeam files through BenchFile, run by ctest: the file given on the command line is read,
+/// written and read again. The program fails if the two benches differ, or if they are not written identically
+
+#include "io/BenchFile.h"
+#include "src/GaussianFit.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+
+int failures = 0;
+
+/// Check that @p condition holds
+#define CHECK(condition) check(condition, #condition, __FILE__, __LINE__)
+
+void check(bool condition, const char* expression, const char* file, int line)
+{
+	if (condition)
+		return;
+
+	cerr << file << ":" << line << ": " << expression << " is false" << endl;
+	failures++;
+}
+
+bool sameBeam(const Beam& beam1, const Beam& beam2)
+{
+	return (beam1.waist(Horizontal)         == beam2.waist(Horizontal)        ) &&
+	       (beam1.waist(Vertical)           == beam2.waist(Vertical)          ) &&
+	       (beam1.waistPosition(Horizontal) == beam2.waistPosition(Horizontal)) &&
+	       (beam1.waistPosition(Vertical)   == beam2.waistPosition(Vertical)  ) &&
+	       (beam1.wavelength()              == beam2.wavelength()             ) &&
+	       (beam1.index()                   == beam2.index()                  ) &&
+	       (beam1.M2()                      == beam2.M2()                     );
+}
+
+int lockParent(const OpticsBench& bench, const Optics* optics)
+{
+	return optics->relativeLockParent() ? bench.opticsIndex(optics->relativeLockParent()) : -1;
+}
+
+void compareBenches(OpticsBench& bench1, OpticsBench& bench2)
+{
+	CHECK(bench1.wavelength() == bench2.wavelength());
+	CHECK(bench1.leftBoundary() == bench2.leftBoundary());
+	CHECK(bench1.rightBoundary() == bench2.rightBoundary());
+	CHECK(sameBeam(*bench1.targetBeam(), *bench2.targetBeam()));
+	CHECK(bench1.targetOverlap() == bench2.targetOverlap());
+	CHECK(bench1.targetOrientation() == bench2.targetOrientation());
+
+	CHECK(bench1.nOptics() == bench2.nOptics());
+	for (int i = 0; (i < bench1.nOptics()) && (i < bench2.nOptics()); i++)
+	{
+		const Optics* optics1 = bench1.optics(i);
+		const Optics* optics2 = bench2.optics(i);
+		CHECK(optics1->type() == optics2->type());
+		CHECK(optics1->name() == optics2->name());
+		CHECK(optics1->position() == optics2->position());
+		CHECK(optics1->angle() == optics2->angle());
+		CHECK(optics1->width() == optics2->width());
+		CHECK(optics1->orientation() == optics2->orientation());
+		CHECK(optics1->absoluteLock() == optics2->absoluteLock());
+		CHECK(lockParent(bench1, optics1) == lockParent(bench2, optics2));
+		if (optics1->isABCD() && optics2->isABCD())
+		{
+			const ABCD* abcd1 = dynamic_cast<const ABCD*>(optics1);
+			const ABCD* abcd2 = dynamic_cast<const ABCD*>(optics2);
+			for (int o = 0; o < 2; o++)
+			{
+				const Orientation orientation = o ? Vertical : Horizontal;
+				CHECK(abcd1->A(orientation) == abcd2->A(orientation));
+				CHECK(abcd1->B(orientation) == abcd2->B(orientation));
+				CHECK(abcd1->C(orientation) == abcd2->C(orientation));
+				CHECK(abcd1->D(orientation) == abcd2->D(orientation));
+			}
+		}
+		if ((optics1->type() == CreateBeamType) && (optics2->type() == CreateBeamType))
+			CHECK(sameBeam(*dynamic_cast<const CreateBeam*>(optics1)->beam(), *dynamic_cast<const CreateBeam*>(optics2)->beam()));
+	}
+
+	CHECK(bench1.nFit() == bench2.nFit());
+	for (int i = 0; (i < bench1.nFit()) && (i < bench2.nFit()); i++)
+		CHECK(*bench1.fit(i) == *bench2.fit(i));
+}
+
+QByteArray readAll(const QString& fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QFile::ReadOnly))
+		return QByteArray();
+
+	return file.readAll();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Q_INIT_RESOURCE(cli);
+
+	QCoreApplication app(argc, argv);
+	if (app.arguments().size() != 2)
+	{
+		cerr << "Usage: gaussianbeam-benchfiletest file" << endl;
+		return 2;
+	}
+
+	const QString fileName = app.arguments()[1];
+	const QString writtenName1 = QDir::temp().filePath("gaussianbeam-benchfiletest-1.xml");
+	const QString writtenName2 = QDir::temp().filePath("gaussianbeam-benchfiletest-2.xml");
+
+	// Read the file, write it and read it again
+	QString error;
+	OpticsBench bench1, bench2;
+	if (!BenchFile(bench1).read(fileName, error) || !BenchFile(bench1).write(writtenName1, error) ||
+	    !BenchFile(bench2).read(writtenName1, error) || !BenchFile(bench2).write(writtenName2, error))
+	{
+		cerr << error.toUtf8().constData() << endl;
+		return 1;
+	}
+
+	CHECK(bench1.nOptics() > 0);
+	CHECK(bench1.nFit() > 0);
+	compareBenches(bench1, bench2);
+	const QByteArray written = readAll(writtenName1);
+	CHECK(!written.isEmpty());
+	CHECK(written == readAll(writtenName2));
+
+	QFile::remove(writtenName1);
+	QFile::remove(writtenName2);
+
+	if (failures > 0)
+	{
+		cerr << failures << " failed checks" << endl;
+		return 1;
+	}
+
+	cout << "All checks passed" << endl;
+	return 0;
+}
@@ -0,0 +1,555 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/**
+* Performance benchmarks of the computation kernels, based on Google Benchmark.
+* Run "make benchmark_json" to write the results to benchmark.json, or run
+* gaussianbeam-benchmark directly with the usual --benchmark_* options.
+* The XML benchmarks are only compiled if Qt is available (GAUSSIANBEAM_BENCHMARK_XML).
+*/
+
+#include "src/GaussianBeam.h"
+#include "src/BeamProfile.h"
+#include "src/Optics.h"
+#include "src/OpticsBench.h"
+#include "src/OpticsFunction.h"
+#include "src/ToleranceAnalysis.h"
+#include "src/CatalogSearch.h"
+#include "src/GaussianFit.h"
+#include "src/FitBootstrap.h"
+#include "src/BeamImage.h"
+
+#ifdef GAUSSIANBEAM_BENCHMARK_XML
+	#include "io/BenchFile.h"
+	#include <QCoreApplication>
+	#include <QDir>
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+/////////////////////////////////////////////////
+// Fixtures
+
+/// Fill @p bench with an input beam followed by @p nLenses lenses
+void populateBench(OpticsBench& bench, int nLenses)
+{
+	bench.populateDefault();
+	bench.setRightBoundary(0.1 + 0.08*nLenses);
+	for (int i = 0; i < nLenses; i++)
+		bench.addOptics(new Lens(0.05 + 0.03*(i % 7), 0.05 + 0.08*i, "L"), bench.nOptics());
+}
+
+/// @return a fit containing @p nData radii of @p beam, with a deterministic noise
+Fit makeFit(const Beam& beam, int nData)
+{
+	Fit fit;
+	fit.setDataType(Radius_e2);
+	for (int i = 0; i < nData; i++)
+	{
+		const double position = -0.2 + 0.4*i/nData;
+		const double noise = 1. + 0.01*((i*7919 % 13) - 6)/6.;
+		fit.addData(position, beam.radius(position)*noise, Spherical);
+	}
+	return fit;
+}
+
+/////////////////////////////////////////////////
+// Beam
+
+void BM_BeamOverlap(benchmark::State& state)
+{
+	Beam beam1(100e-6, 0.01, 633e-9);
+	Beam beam2(120e-6, 0.02, 633e-9);
+	beam2.setWaist(130e-6, Vertical);
+
+	for (auto _ : state)
+	{
+		beam1.setWaistPosition(beam1.waistPosition() + 1e-9);
+		benchmark::DoNotOptimize(Beam::overlap(beam1, beam2));
+	}
+}
+BENCHMARK(BM_BeamOverlap);
+
+void BM_BeamRadius(benchmark::State& state)
+{
+	Beam beam(100e-6, 0.01, 633e-9);
+	double z = 0.;
+
+	for (auto _ : state)
+	{
+		z += 1e-6;
+		benchmark::DoNotOptimize(beam.radius(z));
+	}
+}
+BENCHMARK(BM_BeamRadius);
+
+void BM_BeamQ(benchmark::State& state)
+{
+	Beam beam(100e-6, 0.01, 633e-9);
+	double z = 0.;
+
+	for (auto _ : state)
+	{
+		z += 1e-6;
+		benchmark::DoNotOptimize(beam.q(z));
+	}
+}
+BENCHMARK(BM_BeamQ);
+
+/// Batched radius of one beam
+void BM_BeamProfileRadius(benchmark::State& state)
+{
+	const BeamProfile profile(Beam(100e-6, 0.01, 633e-9));
+	vector<double> z(state.range(0)), radius(state.range(0));
+	for (int i = 0; i < state.range(0); i++)
+		z[i] = -0.5 + double(i)/state.range(0);
+
+	for (auto _ : state)
+	{
+		profile.evaluate(Property::BeamRadius, 0, &z[0], z.size(), &radius[0]);
+		benchmark::DoNotOptimize(&radius[0]);
+	}
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_BeamProfileRadius)->Arg(1024)->Arg(1 << 20);
+
+/////////////////////////////////////////////////
+// ABCD
+
+void BM_ABCDImage(benchmark::State& state)
+{
+	Lens lens(0.1, 0.2);
+	const Optics& optics = lens;
+	Beam beam(100e-6, 0.01, 633e-9);
+
+	for (auto _ : state)
+	{
+		beam.setWaistPosition(beam.waistPosition() + 1e-9);
+		benchmark::DoNotOptimize(optics.image(beam));
+	}
+}
+BENCHMARK(BM_ABCDImage);
+
+void BM_ABCDAntecedent(benchmark::State& state)
+{
+	Lens lens(0.1, 0.2);
+	const Optics& optics = lens;
+	Beam beam(100e-6, 0.4, 633e-9);
+
+	for (auto _ : state)
+	{
+		beam.setWaistPosition(beam.waistPosition() + 1e-9);
+		benchmark::DoNotOptimize(optics.antecedent(beam));
+	}
+}
+BENCHMARK(BM_ABCDAntecedent);
+
+/////////////////////////////////////////////////
+// Bench
+
+/// Full propagation through the bench, triggered by a wavelength change
+void BM_ComputeBeams(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	double wavelength = bench.wavelength();
+
+	for (auto _ : state)
+	{
+		wavelength = (wavelength == 633e-9) ? 634e-9 : 633e-9;
+		bench.setWavelength(wavelength);
+	}
+
+	state.SetItemsProcessed(state.iterations()*bench.nOptics());
+}
+BENCHMARK(BM_ComputeBeams)->Arg(10)->Arg(100)->Arg(1000);
+
+/// Move of the last optics within its slot: only the last beam is propagated again
+void BM_MoveLastOptics(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	const int index = bench.nOptics() - 1;
+	const double position = bench.optics(index)->position();
+
+	for (auto _ : state)
+		bench.setOpticsPosition(index, bench.optics(index)->position() == position ? position + 1e-3 : position);
+}
+BENCHMARK(BM_MoveLastOptics)->Arg(10)->Arg(100)->Arg(1000);
+
+/// Move of the first lens followed by a read of the sensitivities, as when dragging an optics with the sensitivity column shown
+void BM_MoveAndSensitivity(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	const double position = bench.optics(1)->position();
+
+	for (auto _ : state)
+	{
+		bench.setOpticsPosition(1, bench.optics(1)->position() == position ? position + 1e-3 : position);
+		benchmark::DoNotOptimize(bench.sensitivity(bench.nOptics() - 1));
+	}
+}
+BENCHMARK(BM_MoveAndSensitivity)->Arg(10)->Arg(100)->Arg(1000);
+
+/// Propagation of a 100 lens bench for a given number of wavelengths
+void BM_WavelengthSweep(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, 100);
+	vector<double> wavelengths;
+	for (int i = 0; i < state.range(0); i++)
+		wavelengths.push_back(400e-9 + 700e-9*i/state.range(0));
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(bench.wavelengthSweep(wavelengths));
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_WavelengthSweep)->Arg(8)->Arg(64)->UseRealTime();
+
+/// Fit, forced to be recomputed at each iteration by a wavelength change
+void BM_FitApplyFit(benchmark::State& state)
+{
+	const Fit fit = makeFit(Beam(100e-6, 0.01, 633e-9), state.range(0));
+	Beam beam(633e-9);
+
+	for (auto _ : state)
+	{
+		beam.setWavelength(beam.wavelength() == 633e-9 ? 634e-9 : 633e-9);
+		benchmark::DoNotOptimize(fit.applyFit(beam));
+	}
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_FitApplyFit)->Arg(3)->Arg(10)->Arg(100)->Arg(1000);
+
+/// Same as BM_FitApplyFit, with all the initial guesses of the non linear fit
+void BM_FitAllGuesses(benchmark::State& state)
+{
+	Fit fit = makeFit(Beam(100e-6, 0.01, 633e-9), state.range(0));
+	fit.setGuesses(AllPointsGuess | FirstPointsGuess | LastPointsGuess | PairGuesses | MinimumRadiusGuess);
+	Beam beam(633e-9);
+
+	for (auto _ : state)
+	{
+		beam.setWavelength(beam.wavelength() == 633e-9 ? 634e-9 : 633e-9);
+		benchmark::DoNotOptimize(fit.applyFit(beam));
+	}
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_FitAllGuesses)->Arg(10)->Arg(100)->Arg(1000)->UseRealTime();
+
+/// Same as BM_FitApplyFit, with M² as a free parameter
+void BM_FitM2(benchmark::State& state)
+{
+	Fit fit = makeFit(Beam(100e-6, 0.01, 633e-9, 1., 2.), state.range(0));
+	fit.setFitM2(true);
+	Beam beam(633e-9);
+
+	for (auto _ : state)
+	{
+		beam.setWavelength(beam.wavelength() == 633e-9 ? 634e-9 : 633e-9);
+		benchmark::DoNotOptimize(fit.applyFit(beam));
+	}
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_FitM2)->Arg(10)->Arg(100)->Arg(1000);
+
+/// Scan of @p state.range(0) points, the fit being updated after each point, M² being fitted if @p state.range(1)
+void BM_FitScan(benchmark::State& state)
+{
+	const Fit data = makeFit(Beam(100e-6, 0.01, 633e-9), state.range(0));
+	Beam beam(633e-9);
+
+	for (auto _ : state)
+	{
+		Fit fit;
+		fit.setFitM2(state.range(1));
+		for (int i = 0; i < data.size(); i++)
+		{
+			fit.addData(data.position(i), data.value(i, Spherical), Spherical);
+			benchmark::DoNotOptimize(fit.applyFit(beam));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_FitScan)->Args({100, 0})->Args({1000, 0})->Args({1000, 1})->Unit(benchmark::kMillisecond);
+
+/// Same as BM_FitScan, each fit being recomputed from scratch by a wavelength change
+void BM_FitScanCold(benchmark::State& state)
+{
+	const Fit data = makeFit(Beam(100e-6, 0.01, 633e-9), state.range(0));
+	Beam beam(633e-9);
+
+	for (auto _ : state)
+	{
+		Fit fit;
+		fit.setFitM2(state.range(1));
+		for (int i = 0; i < data.size(); i++)
+		{
+			fit.addData(data.position(i), data.value(i, Spherical), Spherical);
+			beam.setWavelength(beam.wavelength() == 633e-9 ? 634e-9 : 633e-9);
+			benchmark::DoNotOptimize(fit.applyFit(beam));
+		}
+	}
+
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_FitScanCold)->Args({100, 0})->Args({1000, 0})->Args({1000, 1})->Unit(benchmark::kMillisecond);
+
+/// Batch of 256 fits of 20 points each, on @p state.range(0) threads
+void BM_FitDatasets(benchmark::State& state)
+{
+	vector<FitDataset> datasets(256);
+	for (unsigned int d = 0; d < datasets.size(); d++)
+	{
+		const Fit fit = makeFit(Beam(50e-6 + 1e-6*d, 0.01, 633e-9), 20);
+		datasets[d].dataType = fit.dataType();
+		datasets[d].wavelength = 633e-9;
+		for (int i = 0; i < fit.size(); i++)
+		{
+			datasets[d].positions.push_back(fit.position(i));
+			datasets[d].values.push_back(fit.value(i, Spherical));
+		}
+	}
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(Fit::fitDatasets(datasets, state.range(0)));
+
+	state.SetItemsProcessed(state.iterations()*datasets.size());
+}
+BENCHMARK(BM_FitDatasets)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/// 2000 bootstrap resamples of a 30 point fit, M² being fitted if @p state.range(0), on @p state.range(1) threads
+void BM_FitBootstrap(benchmark::State& state)
+{
+	Fit fit = makeFit(Beam(100e-6, 0.01, 633e-9, 1., 1.5), 30);
+	fit.setFitM2(state.range(0));
+	FitBootstrap bootstrap(fit);
+	bootstrap.setThreadCount(state.range(1));
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(bootstrap.run(633e-9));
+
+	state.SetItemsProcessed(state.iterations()*bootstrap.sampleCount());
+}
+BENCHMARK(BM_FitBootstrap)->Args({0, 1})->Args({1, 1})->Args({1, 4})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/// Second moment widths of a 1600x1200 frame of an elliptic beam over a noisy background
+void BM_BeamImageAnalyze(benchmark::State& state)
+{
+	BeamImage image;
+	image.width = 1600;
+	image.height = 1200;
+	image.pixelSize = 5e-6;
+	image.pixels.resize(image.width*image.height);
+	for (int y = 0; y < image.height; y++)
+		for (int x = 0; x < image.width; x++)
+		{
+			const double noise = 4.*(((x*7919 + y*104729) % 13) - 6)/6.;
+			const double r2 = sqr((x + 0.5 - 800.3)/60.) + sqr((y + 0.5 - 590.7)/50.);
+			image.pixels[y*image.width + x] = (unsigned short)(300. + noise + 40000.*exp(-2.*r2));
+		}
+	BeamImageAnalysis analysis;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(analysis.analyze(image));
+
+	state.SetItemsProcessed(state.iterations()*image.pixels.size());
+}
+BENCHMARK(BM_BeamImageAnalyze)->Unit(benchmark::kMillisecond);
+
+/// Overlap function of the optimizer. The first lens moves at each iteration, so that the whole chain is recomputed
+void BM_OpticsFunctionValue(benchmark::State& state)
+{
+	vector<Optics*> optics;
+	optics.push_back(new CreateBeam(180e-6, 10e-3, 1., "w0"));
+	for (int i = 0; i < state.range(0); i++)
+		optics.push_back(new Lens(0.05 + 0.03*(i % 7), 0.05 + 0.08*i, "L"));
+
+	OpticsFunction function(optics, 633e-9);
+	function.setOverlapBeam(Beam(100e-6, 0.1*state.range(0), 633e-9));
+	vector<double> x = function.currentPosition();
+	const double x1 = x[1];
+
+	for (auto _ : state)
+	{
+		x[1] = (x[1] == x1) ? x1 + 1e-6 : x1;
+		benchmark::DoNotOptimize(function.value(x));
+	}
+
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+}
+BENCHMARK(BM_OpticsFunctionValue)->Arg(2)->Arg(10)->Arg(100);
+
+/// Magic waist search with a fixed seed, starting each time from the same positions
+void BM_MagicWaist(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	bench.setOptimizationSeed(12345);
+	bench.setTargetOverlap(0.99);
+	vector<double> positions;
+	for (int i = 0; i < bench.nOptics(); i++)
+		positions.push_back(bench.optics(i)->position());
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		for (int i = 0; i < bench.nOptics(); i++)
+			bench.setOpticsPosition(i, positions[i]);
+		state.ResumeTiming();
+		benchmark::DoNotOptimize(bench.magicWaist());
+	}
+}
+BENCHMARK(BM_MagicWaist)->Arg(2)->Arg(3)->Unit(benchmark::kMillisecond);
+
+/// Conjugate gradient search of the overlap maximum, starting each time from the same positions
+void BM_LocalMaximum(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	vector<Optics*> optics = bench.cloneOptics();
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*bench.targetBeam());
+	function.setCheckLock(true);
+	const vector<double> positions = function.currentPosition();
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(function.localMaximum(positions));
+
+	const OptimizationStats& stats = function.stats();
+	state.counters["evaluations"] = benchmark::Counter(stats.evaluations, benchmark::Counter::kAvgIterations);
+	state.counters["gradients"] = benchmark::Counter(stats.gradientEvaluations, benchmark::Counter::kAvgIterations);
+	state.counters["iterations"] = benchmark::Counter(stats.iterations, benchmark::Counter::kAvgIterations);
+
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+}
+BENCHMARK(BM_LocalMaximum)->Arg(2)->Arg(3)->Arg(10);
+
+/// Tolerance analysis on the position and focal length of each lens, single threaded
+void BM_ToleranceAnalysis(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	ToleranceAnalysis analysis(bench);
+	analysis.setThreadCount(1);
+	analysis.setSampleCount(10000);
+	for (int i = 1; i < bench.nOptics(); i++)
+	{
+		analysis.addTolerance(i, OpticsParameter::Position, GaussianDistribution, 0.5e-3);
+		analysis.addTolerance(i, OpticsParameter::Focal, UniformDistribution, 1e-3);
+	}
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(analysis.run());
+
+	state.SetItemsProcessed(state.iterations()*analysis.sampleCount());
+}
+BENCHMARK(BM_ToleranceAnalysis)->Arg(2)->Arg(10)->Unit(benchmark::kMillisecond);
+
+/// Catalog search of two lenses among @p state.range(0) focals each, single threaded
+void BM_LensCatalogSearch(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, 2);
+	vector<double> catalog;
+	for (int i = 0; i < state.range(0); i++)
+		catalog.push_back(0.02*pow(1.25, i));
+
+	LensCatalogSearch search(bench);
+	search.setCatalog(1, catalog);
+	search.setCatalog(2, catalog);
+	search.setThreadCount(1);
+	search.setSampleCount(2000);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(search.run());
+
+	state.SetItemsProcessed(state.iterations()*search.nCombinations());
+	state.counters["pruned"] = search.nPruned();
+}
+BENCHMARK(BM_LensCatalogSearch)->Arg(8)->Arg(16)->Unit(benchmark::kMillisecond);
+
+/////////////////////////////////////////////////
+// XML files
+
+#ifdef GAUSSIANBEAM_BENCHMARK_XML
+
+void BM_BenchFileSave(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	const QString fileName = QDir::temp().filePath("gaussianbeam-benchmark.xml");
+	QString error;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(BenchFile(bench).write(fileName, error));
+
+	state.SetItemsProcessed(state.iterations()*bench.nOptics());
+}
+BENCHMARK(BM_BenchFileSave)->Arg(10)->Arg(100)->Arg(1000);
+
+void BM_BenchFileLoad(benchmark::State& state)
+{
+	OpticsBench bench;
+	populateBench(bench, state.range(0));
+	const QString fileName = QDir::temp().filePath("gaussianbeam-benchmark.xml");
+	QString error;
+	BenchFile(bench).write(fileName, error);
+
+	for (auto _ : state)
+	{
+		OpticsBench loadedBench;
+		benchmark::DoNotOptimize(BenchFile(loadedBench).read(fileName, error));
+	}
+
+	state.SetItemsProcessed(state.iterations()*bench.nOptics());
+}
+BENCHMARK(BM_BenchFileLoad)->Arg(10)->Arg(100)->Arg(1000);
+
+int main(int argc, char** argv)
+{
+	Q_INIT_RESOURCE(cli);
+	QCoreApplication app(argc, argv);
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
+
+#else
+
+BENCHMARK_MAIN();
+
+#endif
@@ -0,0 +1,646 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/// Checks of the core library, without Qt. Run by ctest, the program fails if a check fails
+
+#include "src/GaussianBeam.h"
+#include "src/Optics.h"
+#include "src/OpticsBench.h"
+#include "src/OpticsFunction.h"
+#include "src/ParameterFunction.h"
+#include "src/CatalogSearch.h"
+#include "src/GaussianFit.h"
+#include "src/FitBootstrap.h"
+#include "src/BeamImage.h"
+#include "src/ToleranceAnalysis.h"
+#include "src/Utils.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+int failures = 0;
+
+/// Check that @p value is within @p tolerance of @p expected
+#define CHECK_CLOSE(value, expected, tolerance) checkClose(value, expected, tolerance, #value, __FILE__, __LINE__)
+
+void checkClose(double value, double expected, double tolerance, const char* expression, const char* file, int line)
+{
+	if (fabs(value - expected) <= tolerance)
+		return;
+
+	cerr << file << ":" << line << ": " << expression << " = " << value << ", expected " << expected << " +/- " << tolerance << endl;
+	failures++;
+}
+
+/////////////////////////////////////////////////
+// OpticsFunction
+
+/// Analytic gradient and curvature of the overlap, against central differences
+void checkOpticsFunctionDerivatives()
+{
+	OpticsBench bench;
+	bench.populateDefault();
+	bench.setRightBoundary(0.6);
+	bench.addOptics(new Lens(0.05, 0.05, "L1"), bench.nOptics());
+	bench.addOptics(new CurvedMirror(0.2, 0.15, "M"), bench.nOptics());
+	bench.addOptics(new Lens(0.08, 0.25, "L2"), bench.nOptics());
+	bench.addOptics(new DielectricSlab(1.5, 0.02, 0.3, "S"), bench.nOptics());
+	bench.addOptics(new Lens(0.1, 0.4, "L3"), bench.nOptics());
+	vector<Optics*> optics = bench.cloneOptics();
+
+	for (int checkLock = 0; checkLock < 2; checkLock++)
+	{
+		OpticsFunction function(optics, bench.wavelength());
+		function.setOverlapBeam(*bench.targetBeam());
+		function.setCheckLock(checkLock);
+		vector<double> x = function.currentPosition();
+		for (unsigned int i = 1; i < x.size(); i++)
+			x[i] += 0.013*i;
+
+		const vector<double> gradient = function.gradient(x);
+		const vector<double> curvature = function.curvature(x);
+		for (unsigned int i = 0; i < x.size(); i++)
+		{
+			const double h = 1e-5;
+			vector<double> plus = x, minus = x;
+			plus[i] += h;
+			minus[i] -= h;
+			const double value = function.value(x);
+			const double valuePlus = function.value(plus);
+			const double valueMinus = function.value(minus);
+			const double difference = (valuePlus - valueMinus)/(2.*h);
+			const double secondDifference = (valuePlus - 2.*value + valueMinus)/sqr(h);
+			CHECK_CLOSE(gradient[i], difference, 1e-6*(1. + fabs(difference)));
+			CHECK_CLOSE(curvature[i], secondDifference, 1e-3*(1. + fabs(secondDifference)));
+		}
+	}
+
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+}
+
+/// The local optimum respects the bench boundaries, the optics order and the relative locks
+void checkBenchConstraints()
+{
+	// The unconstrained optimum has L2 beyond the right boundary
+	OpticsBench bench, target;
+	OpticsBench* benches[2] = {&bench, &target};
+	for (int b = 0; b < 2; b++)
+	{
+		benches[b]->populateDefault();
+		benches[b]->addOptics(new Lens(0.1, 0.05, "L1"), benches[b]->nOptics());
+		benches[b]->addOptics(new DielectricSlab(1.5, 0.02, 0.15, "S"), benches[b]->nOptics());
+		benches[b]->addOptics(new Lens(0.1, b ? 0.32 : 0.25, "L2"), benches[b]->nOptics());
+	}
+	bench.setRightBoundary(0.3);
+	vector<Optics*> optics = bench.cloneOptics();
+	optics[2]->relativeLockTo(optics[1]);
+
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*target.beam(target.nOptics() - 1));
+	function.setCheckLock(true);
+	function.setBenchConstraints(bench.leftBoundary(), bench.rightBoundary());
+	const vector<double> start = function.currentPosition();
+	const vector<double> x = function.localMaximum(start);
+	if (function.value(x) <= function.value(start))
+	{
+		cerr << "Bench constraints: the local search did not improve the overlap" << endl;
+		failures++;
+	}
+
+	// Positions of the optics, as committed by OpticsBench
+	const double value = function.value(x);
+	for (unsigned int i = 0; i < optics.size(); i++)
+		optics[i]->setPosition(x[i], true);
+	CHECK_CLOSE(optics[0]->position(), start[0], 0.);
+	CHECK_CLOSE(optics[2]->position() - optics[1]->position(), start[2] - start[1], 1e-12);
+	CHECK_CLOSE(optics[3]->position(), bench.rightBoundary(), 1e-9);
+	for (unsigned int i = 1; i < optics.size(); i++)
+		if ((optics[i]->position() < bench.leftBoundary() - 1e-9) || (optics[i]->position() > bench.rightBoundary() + 1e-9) ||
+		    (optics[i-1]->endPosition() > optics[i]->position() + 1e-9))
+		{
+			cerr << "Bench constraints: " << optics[i]->name() << " is out of the bench or overlaps " << optics[i-1]->name() << endl;
+			failures++;
+		}
+
+	// Moving the free locking tree does not improve the overlap
+	for (int sign = -1; sign <= 1; sign += 2)
+	{
+		vector<double> moved = x;
+		moved[2] += sign*1e-4;
+		if (function.value(moved) > value + 1e-12)
+		{
+			cerr << "Bench constraints: the local search stopped before the optimum" << endl;
+			failures++;
+		}
+	}
+
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+}
+
+/////////////////////////////////////////////////
+// Function
+
+/// Statistics of the threads of a search are summed field by field
+void checkOptimizationStats()
+{
+	OptimizationStats stats, other;
+	other.evaluations = 1;
+	other.gradientEvaluations = 2;
+	other.lineSearches = 3;
+	other.bracketExpansions = 4;
+	other.iterations = 5;
+	stats += other;
+	stats += other;
+	CHECK_CLOSE(stats.evaluations, 2., 0.);
+	CHECK_CLOSE(stats.gradientEvaluations, 4., 0.);
+	CHECK_CLOSE(stats.lineSearches, 6., 0.);
+	CHECK_CLOSE(stats.bracketExpansions, 8., 0.);
+	CHECK_CLOSE(stats.iterations, 10., 0.);
+}
+
+/////////////////////////////////////////////////
+// Fit
+
+/// On noisy hyperbolas, with or without M², a fit whose points are added one at a time in any order is as good as a fit
+/// of all points at once
+void checkFitIncremental()
+{
+	const double wavelength = 633e-9;
+	mt19937 random(3);
+	uniform_real_distribution<double> uniform(0., 1.);
+	for (int s = 0; s < 2000; s++)
+	{
+		const int nPoints = 5 + s%40;
+		const double noise = (s%2) ? 0.2 : 0.05;
+		const Beam beam(30e-6 + 300e-6*uniform(random), 0.5*uniform(random) - 0.1, wavelength, 1., 1.);
+		vector<pair<double, double> > points;
+		for (int i = 0; i < nPoints; i++)
+		{
+			const double position = 0.4*i/nPoints;
+			points.push_back(make_pair(position, beam.radius(position)*(1. + noise*(uniform(random) - 0.5))));
+		}
+		shuffle(points.begin(), points.end(), random);
+
+		Fit incremental, batch;
+		incremental.setFitM2((s/2)%2);
+		batch.setFitM2((s/2)%2);
+		Beam result(wavelength);
+		double residue = 0.;
+		for (vector<pair<double, double> >::const_iterator it = points.begin(); it != points.end(); it++)
+		{
+			incremental.addData(it->first, it->second, Spherical);
+			residue = incremental.applyFit(result);
+			batch.addData(it->first, it->second, Spherical);
+		}
+		const double batchResidue = batch.applyFit(result);
+		if (residue > batchResidue*(1. + 1e-6))
+			CHECK_CLOSE(residue, batchResidue, 1e-6*batchResidue);
+	}
+}
+
+/// Fit::fitDatasets gives the result of Fit::applyFit on each dataset, whatever the number of threads
+void checkFitDatasets()
+{
+	mt19937 random(5);
+	uniform_real_distribution<double> uniform(0., 1.);
+	vector<FitDataset> datasets(60);
+	for (unsigned int d = 0; d < datasets.size(); d++)
+	{
+		FitDataset& dataset = datasets[d];
+		dataset.wavelength = (d%2) ? 1064e-9 : 633e-9;
+		dataset.dataType = FitDataType(d%5);
+		dataset.fitM2 = (d%3 == 0);
+		const Beam beam(50e-6 + 200e-6*uniform(random), 0.3*uniform(random), dataset.wavelength, 1., dataset.fitM2 ? 1.5 : 1.);
+		// Datasets with a single value can not be fitted
+		const int nPoints = (d%20 == 7) ? 1 : 4 + d%30;
+		for (int i = 0; i < nPoints; i++)
+		{
+			const double position = -0.1 + 0.5*i/nPoints;
+			dataset.positions.push_back(position);
+			dataset.values.push_back((i%9 == 4) ? 0. : beam.radius(position)*(1. + 0.1*(uniform(random) - 0.5)));
+		}
+	}
+
+	const vector<FitResult> results = Fit::fitDatasets(datasets, 4);
+	CHECK_CLOSE(results.size(), datasets.size(), 0.);
+	for (unsigned int d = 0; (d < datasets.size()) && (d < results.size()); d++)
+	{
+		const FitDataset& dataset = datasets[d];
+		const FitResult& result = results[d];
+		Fit fit;
+		fit.setDataType(dataset.dataType);
+		fit.setFitM2(dataset.fitM2);
+		int nonZero = 0;
+		for (unsigned int i = 0; i < dataset.positions.size(); i++)
+		{
+			fit.addData(dataset.positions[i], dataset.values[i], Spherical);
+			nonZero += (dataset.values[i] != 0.);
+		}
+
+		CHECK_CLOSE(result.success, nonZero >= 2, 0.);
+		if (!result.success)
+			continue;
+		Beam beam(dataset.wavelength);
+		CHECK_CLOSE(result.residue, fit.applyFit(beam), 0.);
+		CHECK_CLOSE(result.waist, beam.waist(), 0.);
+		CHECK_CLOSE(result.waistPosition, beam.waistPosition(), 0.);
+		CHECK_CLOSE(result.M2, fit.M2(), 0.);
+		CHECK_CLOSE(result.covariance.size(), fit.covariance().size(), 0.);
+		for (unsigned int i = 0; (i < result.covariance.size()) && (i < fit.covariance().size()); i++)
+			CHECK_CLOSE(result.covariance[i], fit.covariance()[i], 0.);
+	}
+}
+
+/// M², waists and waist positions recovered from exact radii
+void checkFitM2()
+{
+	const double wavelength = 1e-6;
+	Beam beam(100e-6, 0.02, wavelength, 1., 1.8);
+	beam.setWaist(140e-6, Vertical);
+	beam.setWaistPosition(-0.01, Vertical);
+	Fit fit;
+	CHECK_CLOSE(fit.fitM2(), 0., 0.);
+	fit.setOrientation(Ellipsoidal);
+	fit.setFitM2(true);
+	for (int i = 0; i < 15; i++)
+	{
+		const double position = -0.3 + 0.6*i/14.;
+		fit.addData(position, beam.radius(position, Horizontal), Horizontal);
+		fit.setData(i, position, beam.radius(position, Vertical), Vertical);
+	}
+	Beam result(wavelength);
+	CHECK_CLOSE(fit.applyFit(result), 0., 1e-12);
+	CHECK_CLOSE(fit.M2(), 1.8, 1e-6);
+	CHECK_CLOSE(result.M2(), 1.8, 1e-6);
+	CHECK_CLOSE(result.waist(Horizontal), 100e-6, 1e-12);
+	CHECK_CLOSE(result.waist(Vertical), 140e-6, 1e-12);
+	CHECK_CLOSE(result.waistPosition(Horizontal), 0.02, 1e-9);
+	CHECK_CLOSE(result.waistPosition(Vertical), -0.01, 1e-9);
+	CHECK_CLOSE(fit.covariance().size(), 25., 0.);
+
+	// Radii that no hyperbola fits: M² is fitted from the M² = 1 fit only, and can not do worse
+	Fit concave, fixed;
+	concave.setFitM2(true);
+	const double radii[5] = {100e-6, 150e-6, 160e-6, 150e-6, 100e-6};
+	for (int i = 0; i < 5; i++)
+	{
+		concave.addData(0.1*i, radii[i], Spherical);
+		fixed.addData(0.1*i, radii[i], Spherical);
+	}
+	const double fixedResidue = fixed.applyFit(result);
+	const double residue = concave.applyFit(result);
+	if (!(residue <= fixedResidue*(1. + 1e-9)))
+		CHECK_CLOSE(residue, fixedResidue, 1e-9*fixedResidue);
+	CHECK_CLOSE(result.waist(), result.waist(), 0.);
+	CHECK_CLOSE(concave.M2(), concave.M2(), 0.);
+	CHECK_CLOSE(concave.covariance().size(), 9., 0.);
+}
+
+/////////////////////////////////////////////////
+// FitBootstrap
+
+/// @return a fit of 12 noisy radii of a beam of M² 1.5, whose M² is fitted if @p fitM2
+Fit makeNoisyFit(bool fitM2)
+{
+	const Beam beam(100e-6, 0.01, 633e-9, 1., 1.5);
+	Fit fit;
+	fit.setFitM2(fitM2);
+	for (int i = 0; i < 12; i++)
+	{
+		const double position = -0.2 + 0.4*i/12.;
+		fit.addData(position, beam.radius(position)*(1. + 0.02*((i*7919 % 13) - 6)/6.), Spherical);
+	}
+	return fit;
+}
+
+/// Bootstrap intervals do not depend on the number of threads
+void checkFitBootstrapThreads()
+{
+	for (int fitM2 = 0; fitM2 < 2; fitM2++)
+	{
+		const Fit fit = makeNoisyFit(fitM2);
+		FitBootstrap bootstrap1(fit), bootstrap4(fit);
+		bootstrap1.setSampleCount(300);
+		bootstrap1.setThreadCount(1);
+		bootstrap4.setSampleCount(300);
+		bootstrap4.setThreadCount(4);
+		CHECK_CLOSE(bootstrap1.run(633e-9), 1., 0.);
+		CHECK_CLOSE(bootstrap4.run(633e-9), 1., 0.);
+		CHECK_CLOSE(bootstrap1.nSamples(), bootstrap4.nSamples(), 0.);
+		const FitInterval intervals1[3] = {bootstrap1.waist(), bootstrap1.waistPosition(), bootstrap1.M2()};
+		const FitInterval intervals4[3] = {bootstrap4.waist(), bootstrap4.waistPosition(), bootstrap4.M2()};
+		for (int k = 0; k < 3; k++)
+		{
+			CHECK_CLOSE(intervals1[k].lower, intervals4[k].lower, 0.);
+			CHECK_CLOSE(intervals1[k].upper, intervals4[k].upper, 0.);
+			CHECK_CLOSE(intervals1[k].deviation, intervals4[k].deviation, 0.);
+		}
+	}
+}
+
+/// Jackknife intervals against the leave one out fits computed with applyFit
+void checkFitJackknife()
+{
+	for (int fitM2 = 0; fitM2 < 2; fitM2++)
+	{
+		const Fit fit = makeNoisyFit(fitM2);
+		FitBootstrap jackknife(fit);
+		jackknife.setMethod(JackknifeResampling);
+		CHECK_CLOSE(jackknife.run(633e-9), 1., 0.);
+		CHECK_CLOSE(jackknife.nSamples(), fit.size(), 0.);
+
+		// Leave one out estimates of the waist, waist position and M²
+		const int n = fit.size();
+		vector<double> estimates[3];
+		for (int left = 0; left < n; left++)
+		{
+			Fit resample;
+			resample.setFitM2(fitM2);
+			for (int i = 0; i < n; i++)
+				if (i != left)
+					resample.addData(fit.position(i), fit.value(i, Spherical), Spherical);
+			Beam beam(633e-9);
+			resample.applyFit(beam);
+			estimates[0].push_back(beam.waist());
+			estimates[1].push_back(beam.waistPosition());
+			estimates[2].push_back(resample.M2());
+		}
+
+		Beam beam(633e-9);
+		Fit full(fit);
+		full.applyFit(beam);
+		const double values[3] = {beam.waist(), beam.waistPosition(), full.M2()};
+		const FitInterval intervals[3] = {jackknife.waist(), jackknife.waistPosition(), jackknife.M2()};
+		for (int k = 0; k < 3; k++)
+		{
+			double mean = 0., sumSquares = 0.;
+			for (int i = 0; i < n; i++)
+				mean += estimates[k][i]/n;
+			for (int i = 0; i < n; i++)
+				sumSquares += sqr(estimates[k][i] - mean);
+			const double deviation = sqrt(sumSquares*(n - 1)/n);
+			CHECK_CLOSE(intervals[k].value, values[k], 1e-9*fabs(values[k]));
+			CHECK_CLOSE(intervals[k].deviation, deviation, 1e-6*deviation + 1e-15);
+			CHECK_CLOSE(intervals[k].lower, values[k] - 1.959964*deviation, 1e-6*deviation + 1e-15);
+			CHECK_CLOSE(intervals[k].upper, values[k] + 1.959964*deviation, 1e-6*deviation + 1e-15);
+		}
+		if (fitM2 && !(intervals[2].deviation > 0.))
+		{
+			cerr << "FitBootstrap: the jackknife M² deviation vanishes" << endl;
+			failures++;
+		}
+	}
+}
+
+/////////////////////////////////////////////////
+// BeamImage
+
+/// Second moment radii and centroid of a synthetic elliptic beam over a uniform background
+void checkBeamImageAnalysis()
+{
+	BeamImage image;
+	image.width = 400;
+	image.height = 300;
+	image.pixelSize = 5e-6;
+	image.position = 0.1;
+	image.pixels.resize(image.width*image.height);
+	const double centerX = 201.3, centerY = 140.6, radiusX = 30., radiusY = 20.;
+	for (int y = 0; y < image.height; y++)
+		for (int x = 0; x < image.width; x++)
+		{
+			const double r2 = sqr((x + 0.5 - centerX)/radiusX) + sqr((y + 0.5 - centerY)/radiusY);
+			image.pixels[y*image.width + x] = (unsigned short)(floor(200. + 30000.*exp(-2.*r2) + 0.5));
+		}
+
+	BeamImageAnalysis analysis;
+	const BeamMoments moments = analysis.analyze(image);
+	CHECK_CLOSE(moments.valid, 1., 0.);
+	CHECK_CLOSE(moments.position, 0.1, 0.);
+	CHECK_CLOSE(moments.background, 200., 1e-9);
+	CHECK_CLOSE(moments.centroidX/image.pixelSize, centerX, 1e-3);
+	CHECK_CLOSE(moments.centroidY/image.pixelSize, centerY, 1e-3);
+	CHECK_CLOSE(moments.radiusX/image.pixelSize, radiusX, 1e-2*radiusX);
+	CHECK_CLOSE(moments.radiusY/image.pixelSize, radiusY, 1e-2*radiusY);
+}
+
+/////////////////////////////////////////////////
+// LensCatalogSearch
+
+/// Pruning by the overlap bound does not change the designs found by an exhaustive search
+void checkCatalogSearchPruning()
+{
+	OpticsBench bench;
+	bench.populateDefault();
+	bench.setRightBoundary(0.26);
+	bench.addOptics(new Lens(0.05, 0.05, "L1"), bench.nOptics());
+	bench.addOptics(new Lens(0.08, 0.13, "L2"), bench.nOptics());
+	vector<double> catalog;
+	for (int i = 0; i < 8; i++)
+		catalog.push_back(0.02*pow(1.25, i));
+
+	LensCatalogSearch pruned(bench), exhaustive(bench);
+	LensCatalogSearch* searches[2] = {&pruned, &exhaustive};
+	for (int s = 0; s < 2; s++)
+	{
+		searches[s]->setCatalog(1, catalog);
+		searches[s]->setCatalog(2, catalog);
+		searches[s]->setResultCount(5);
+		searches[s]->setSampleCount(2000);
+		searches[s]->setThreadCount(s ? 1 : 4);
+		searches[s]->setPruning(s == 0);
+		CHECK_CLOSE(searches[s]->run(), 1., 0.);
+	}
+
+	CHECK_CLOSE(exhaustive.nPruned(), 0., 0.);
+	CHECK_CLOSE(exhaustive.nEvaluated(), 64., 0.);
+	CHECK_CLOSE(pruned.nEvaluated() + pruned.nPruned(), 64., 0.);
+	if (pruned.nPruned() == 0)
+	{
+		cerr << "LensCatalogSearch: no combination was pruned" << endl;
+		failures++;
+	}
+	CHECK_CLOSE(pruned.results().size(), exhaustive.results().size(), 0.);
+	for (unsigned int i = 0; (i < pruned.results().size()) && (i < exhaustive.results().size()); i++)
+	{
+		CHECK_CLOSE(pruned.results()[i].combination, exhaustive.results()[i].combination, 0.);
+		CHECK_CLOSE(pruned.results()[i].overlap, exhaustive.results()[i].overlap, 0.);
+		CHECK_CLOSE(pruned.results()[i].length, exhaustive.results()[i].length, 0.);
+	}
+}
+
+/////////////////////////////////////////////////
+// ParameterFunction
+
+/// @return the overlap of the output beam of @p optics with @p target
+double outputOverlap(const vector<Optics*>& optics, double wavelength, const Beam& target)
+{
+	OpticsFunction function(optics, wavelength);
+	function.setOverlapBeam(target);
+	return function.value(function.currentPosition());
+}
+
+/// Tied parameters follow their variable, and bounded variables are clamped to their bounds
+void checkParameterFunction()
+{
+	OpticsBench bench, target;
+	OpticsBench* benches[2] = {&bench, &target};
+	for (int b = 0; b < 2; b++)
+	{
+		benches[b]->populateDefault();
+		benches[b]->setRightBoundary(0.7);
+		benches[b]->addOptics(new Lens(b ? 0.12 : 0.1, 0.1, "L1"), benches[b]->nOptics());
+		benches[b]->addOptics(new Lens(b ? 0.25 : 0.15, 0.35, "L2"), benches[b]->nOptics());
+	}
+	bench.setTargetBeam(*target.beam(target.nOptics() - 1));
+
+	// Focal length of L2 = 2*f1 + 0.01, where f1 is the focal length of L1, bounded to [0.05, 0.2]
+	ParameterFunction function(bench);
+	CHECK_CLOSE(function.addVariable(0, OpticsParameter::Focal), -1., 0.);
+	const int focal = function.addVariable(1, OpticsParameter::Focal);
+	CHECK_CLOSE(focal, 0., 0.);
+	CHECK_CLOSE(function.tie(2, OpticsParameter::Focal, focal + 1), 0., 0.);
+	CHECK_CLOSE(function.tie(2, OpticsParameter::Focal, focal, 2., 0.01), 1., 0.);
+	CHECK_CLOSE(function.setVariableBounds(focal, 0.2, 0.05), 0., 0.);
+	CHECK_CLOSE(function.setVariableBounds(focal, 0.05, 0.2), 1., 0.);
+
+	vector<Optics*> optics = bench.cloneOptics();
+	const double focals[3] = {0.08, 0.12, 0.2};
+	for (int f = 0; f < 3; f++)
+	{
+		dynamic_cast<Lens*>(optics[1])->setFocal(focals[f]);
+		dynamic_cast<Lens*>(optics[2])->setFocal(2.*focals[f] + 0.01);
+		CHECK_CLOSE(function.value(vector<double>(1, focals[f])), outputOverlap(optics, bench.wavelength(), *bench.targetBeam()), 1e-12);
+	}
+	CHECK_CLOSE(function.value(vector<double>(1, 0.12)), 1., 1e-12);
+
+	// Out of bounds variables are clamped
+	CHECK_CLOSE(function.value(vector<double>(1, 0.5)), function.value(vector<double>(1, 0.2)), 0.);
+	function.apply(vector<double>(1, 0.5), optics);
+	CHECK_CLOSE(dynamic_cast<Lens*>(optics[1])->focal(), 0.2, 1e-15);
+	CHECK_CLOSE(dynamic_cast<Lens*>(optics[2])->focal(), 0.41, 1e-15);
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+
+	// The maximum within the bounds is the focal length of the target, also found by a copy
+	const ParameterFunction copy(function);
+	const vector<double> maximum = copy.absoluteMaximum();
+	CHECK_CLOSE(maximum.size(), 1., 0.);
+	CHECK_CLOSE(maximum[0], 0.12, 1e-3);
+	CHECK_CLOSE(function.value(maximum), 1., 1e-5);
+}
+
+/////////////////////////////////////////////////
+// ToleranceAnalysis
+
+/// Overlap statistics that do not depend on the number of threads, and that match the two pass statistics of the samples
+void checkToleranceAnalysis()
+{
+	OpticsBench bench;
+	bench.populateDefault();
+	bench.setRightBoundary(0.7);
+	bench.addOptics(new Lens(0.1, 0.1, "L1"), bench.nOptics());
+	bench.addOptics(new Lens(0.15, 0.35, "L2"), bench.nOptics());
+	// Target the output beam: the overlaps are close to 1, with a small deviation
+	bench.setTargetBeam(*bench.beam(bench.nOptics() - 1));
+
+	const unsigned int seed = 7;
+	const int sampleCount = 3000;
+	const double width = 2e-4;
+	ToleranceAnalysis analysis1(bench), analysis4(bench);
+	analysis1.setThreadCount(1);
+	analysis4.setThreadCount(4);
+	ToleranceAnalysis* analyses[2] = {&analysis1, &analysis4};
+	for (int a = 0; a < 2; a++)
+	{
+		analyses[a]->setSampleCount(sampleCount);
+		analyses[a]->setSeed(seed);
+		analyses[a]->addTolerance(1, OpticsParameter::Position, UniformDistribution, width);
+		CHECK_CLOSE(analyses[a]->run(), 1., 0.);
+	}
+	CHECK_CLOSE(analysis1.nominalOverlap(), 1., 1e-12);
+	CHECK_CLOSE(analysis4.meanOverlap(), analysis1.meanOverlap(), 0.);
+	CHECK_CLOSE(analysis4.overlapDeviation(), analysis1.overlapDeviation(), 0.);
+	CHECK_CLOSE(analysis4.yield(), analysis1.yield(), 0.);
+	CHECK_CLOSE(analysis4.histogram() == analysis1.histogram(), 1., 0.);
+
+	// Same samples: each chunk of 1024 samples has its own generator, seeded by the seed and the chunk index
+	vector<Optics*> optics = bench.cloneOptics();
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*bench.targetBeam());
+	const vector<double> nominal = function.currentPosition();
+	vector<double> overlaps;
+	for (int c = 0; c*1024 < sampleCount; c++)
+	{
+		seed_seq sequence = {seed, (unsigned int)(c)};
+		mt19937 random(sequence);
+		for (int s = c*1024; (s < sampleCount) && (s < (c + 1)*1024); s++)
+		{
+			vector<double> x = nominal;
+			x[1] += width*(2.*(random() + 0.5)/4294967296. - 1.);
+			overlaps.push_back(::max(0., function.value(x)));
+		}
+	}
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+
+	double mean = 0., squares = 0.;
+	for (vector<double>::const_iterator it = overlaps.begin(); it != overlaps.end(); it++)
+		mean += *it/overlaps.size();
+	for (vector<double>::const_iterator it = overlaps.begin(); it != overlaps.end(); it++)
+		squares += sqr(*it - mean);
+	const double deviation = sqrt(squares/(overlaps.size() - 1.));
+	CHECK_CLOSE(analysis1.meanOverlap(), mean, 1e-14);
+	CHECK_CLOSE(analysis1.overlapDeviation(), deviation, 1e-9*deviation);
+}
+
+}
+
+int main()
+{
+	checkOpticsFunctionDerivatives();
+	checkOptimizationStats();
+	checkBenchConstraints();
+	checkFitIncremental();
+	checkFitDatasets();
+	checkFitM2();
+	checkFitBootstrapThreads();
+	checkFitJackknife();
+	checkBeamImageAnalysis();
+	checkCatalogSearchPruning();
+	checkParameterFunction();
+	checkToleranceAnalysis();
+
+	if (failures > 0)
+	{
+		cerr << failures << " failed checks" << endl;
+		return 1;
+	}
+
+	cout << "All checks passed" << endl;
+	return 0;
+}